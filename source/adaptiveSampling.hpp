@@ -0,0 +1,87 @@
+#ifndef ADAPTIVE_SAMPLING_HPP
+#define ADAPTIVE_SAMPLING_HPP
+
+#include <vector>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+#include "tileScheduler.hpp"
+
+struct adaptiveSettings{
+    int minSampleCount = 16;        //samples every pixel gets before its error is trusted
+    int maxSampleCount = 1024;      //cap for pixels that never converge, caustics and small lights
+    int samplesPerRound = 16;       //samples added to the unconverged pixels per round
+    float errorThreshold = 0.005f;  //display error at which a pixel stops, 1/255 is about 0.004
+};
+
+//renders minSampleCount samples into every pixel of the tile, then keeps adding rounds of samples to the pixels whose error
+//is above the threshold until they converge or hit the cap. The error of a pixel is the largest displayError in its 3x3 neighbourhood
+//inside the tile, a pixel whose few samples all missed a small light has zero variance but noisy neighbours and keeps sampling.
+//A pixel that converged once is never sampled again, so all pixels that are still active have the same sample count and continue
+//the same sample sequence. Runs of neighbouring active pixels in a row are handed to the renderer as one tile so the packet path
+//still gets full packets
+inline void renderTileAdaptive(const imageTile& tile, const renderSettings& settings, const adaptiveSettings& adaptive, renderFunction renderer,
+                               framebuffer& output, aovBuffers* aovs, const camera& worldCamera, const hittableList& world){
+    const int maxSampleCount = std::max(1, adaptive.maxSampleCount);
+
+    renderSettings pass = settings;
+    pass.sampleBudget = maxSampleCount;
+    pass.sampleStart = 0;
+    pass.pixelSampleCount = std::min(std::max(2, adaptive.minSampleCount), maxSampleCount);
+    renderer(tile, pass, output, aovs, worldCamera, world);
+
+    const int tileWidth = tile.width();
+    std::vector<float> pixelErrors(static_cast<size_t>(tileWidth) * tile.height());
+    std::vector<char> active(pixelErrors.size());
+
+    int sampleCount = pass.pixelSampleCount;
+    while(sampleCount < maxSampleCount){
+        pass.sampleStart = sampleCount;
+        pass.pixelSampleCount = std::min(std::max(1, adaptive.samplesPerRound), maxSampleCount - sampleCount);
+        bool anyActive = false;
+
+        for(int row = tile.row0; row < tile.row1; row++){
+            for(int x = tile.x0; x < tile.x1; x++){
+                pixelErrors[(row - tile.row0) * tileWidth + x - tile.x0] = output.displayError(x, row);
+            }
+        }
+
+        //pixels that stopped in an earlier round have fewer samples and stay stopped
+        for(int row = tile.row0; row < tile.row1; row++){
+            for(int x = tile.x0; x < tile.x1; x++){
+                float error = 0.0f;
+                for(int neighbourRow = std::max(tile.row0, row - 1); neighbourRow <= std::min(tile.row1 - 1, row + 1); neighbourRow++){
+                    for(int neighbourX = std::max(tile.x0, x - 1); neighbourX <= std::min(tile.x1 - 1, x + 1); neighbourX++){
+                        error = std::max(error, pixelErrors[(neighbourRow - tile.row0) * tileWidth + neighbourX - tile.x0]);
+                    }
+                }
+                active[(row - tile.row0) * tileWidth + x - tile.x0] = output.sampleCount(x, row) == sampleCount && error > adaptive.errorThreshold;
+            }
+        }
+
+        for(int row = tile.row0; row < tile.row1; row++){
+            const char* activeRow = &active[(row - tile.row0) * tileWidth];
+            int x = tile.x0;
+            while(x < tile.x1){
+                if(!activeRow[x - tile.x0]){
+                    x++;
+                    continue;
+                }
+
+                int runEnd = x + 1;
+                while(runEnd < tile.x1 && activeRow[runEnd - tile.x0])
+                    runEnd++;
+
+                renderer(imageTile{ x, row, runEnd, row + 1 }, pass, output, aovs, worldCamera, world);
+                anyActive = true;
+                x = runEnd;
+            }
+        }
+
+        if(!anyActive)
+            break;
+        sampleCount += pass.pixelSampleCount;
+    }
+}
+
+#endif //ADAPTIVE_SAMPLING_HPP
@@ -0,0 +1,145 @@
+#ifndef AOV_HPP
+#define AOV_HPP
+
+#include <vector>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "rng.hpp"
+#include "hittable.hpp"
+#include "material.hpp"
+#include "framebuffer.hpp"
+
+//first hit data of the samples of one pixel, filled from the camera rays of the beauty pass
+struct aovSample{
+    color albedo = color(0,0,0);
+    glm::vec3 normal = glm::vec3(0,0,0);
+    float depth = 0.0f;
+    uint32_t objectId = 0;
+    uint32_t materialId = 0;
+    int sampleCount = 0;
+
+    //ids are taken from the first sample only, averaging them would produce ids that do not exist
+    void add(const ray& r, bool hit, const hitRecord& record, const color& backgroundColor){
+        if(hit){
+            color attenuation;
+            albedo += glm::clamp(record.materialPointer->getAlbedoColor(r, record, attenuation), 0.0f, 1.0f);
+            normal += record.normal;
+            depth += record.distance * glm::length(r.direction());
+            if(sampleCount == 0){
+                objectId = record.objectId;
+                materialId = record.materialPointer->materialId;
+            }
+        }
+        else{
+            albedo += backgroundColor;
+        }
+        sampleCount++;
+    }
+};
+
+//auxiliary outputs of the render: albedo, normal in [-1, 1] and camera distance are averaged over the samples like the beauty image,
+//object and material ids hold the first sample's hit, 0 where the camera ray escaped
+class aovBuffers{
+private:
+    int width;
+    int height;
+
+public:
+    framebuffer albedo;
+    framebuffer normal;
+    framebuffer depth;
+    std::vector<uint32_t> objectId;
+    std::vector<uint32_t> materialId;
+
+    aovBuffers(int width = 0, int height = 0):
+        width{width},
+        height{height},
+        albedo(width, height),
+        normal(width, height),
+        depth(width, height),
+        objectId(static_cast<size_t>(width) * height, 0),
+        materialId(static_cast<size_t>(width) * height, 0)
+        {}
+
+    void addSamples(int x, int row, const aovSample& samples){
+        albedo.addSamples(x, row, samples.albedo, samples.sampleCount);
+        normal.addSamples(x, row, samples.normal, samples.sampleCount);
+        depth.addSamples(x, row, color(samples.depth), samples.sampleCount);
+
+        size_t index = static_cast<size_t>(row) * width + x;
+        if(objectId[index] == 0){
+            objectId[index] = samples.objectId;
+            materialId[index] = samples.materialId;
+        }
+    }
+
+    //8 bit rgb images for png output: depth as gray from near (white) to far, escaped camera rays are black. The range leaves out
+    //the outer percent of the distances, edge pixels averaging hits and misses would stretch it
+    void writeDepthSDR(std::vector<uint8_t>& sdrBuffer) const {
+        std::vector<float> distances;
+        for(int row = 0; row < height; row++){
+            for(int x = 0; x < width; x++){
+                const float distance = depth.getPixel(x, row).r;
+                if(distance > 0.0f)
+                    distances.push_back(distance);
+            }
+        }
+        std::sort(distances.begin(), distances.end());
+        const float nearest = distances.empty() ? 0.0f : distances[distances.size() / 100];
+        const float farthest = distances.empty() ? 0.0f : distances[distances.size() - 1 - distances.size() / 100];
+        const float range = std::max(farthest - nearest, 1e-6f);
+
+        sdrBuffer.assign(static_cast<size_t>(width) * height * 3, 0);
+        for(int row = 0; row < height; row++){
+            for(int x = 0; x < width; x++){
+                const float distance = depth.getPixel(x, row).r;
+                if(distance <= 0.0f)
+                    continue;
+                const uint8_t gray = static_cast<uint8_t>(255.0f * (1.0f - 0.9f * glm::clamp((distance - nearest) / range, 0.0f, 1.0f)));
+                const size_t index = (static_cast<size_t>(row) * width + x) * 3;
+                sdrBuffer[index + 0] = gray;
+                sdrBuffer[index + 1] = gray;
+                sdrBuffer[index + 2] = gray;
+            }
+        }
+    }
+
+    //every id gets a random but fixed color, id 0 is black
+    void writeIdSDR(const std::vector<uint32_t>& ids, std::vector<uint8_t>& sdrBuffer) const {
+        sdrBuffer.assign(ids.size() * 3, 0);
+        for(size_t i = 0; i < ids.size(); i++){
+            if(ids[i] == 0)
+                continue;
+            const uint64_t hashed = mixSeed(ids[i]);
+            sdrBuffer[i * 3 + 0] = static_cast<uint8_t>(64 + (hashed & 0xbf));
+            sdrBuffer[i * 3 + 1] = static_cast<uint8_t>(64 + ((hashed >> 8) & 0xbf));
+            sdrBuffer[i * 3 + 2] = static_cast<uint8_t>(64 + ((hashed >> 16) & 0xbf));
+        }
+    }
+
+    void clear(){
+        albedo.clear();
+        normal.clear();
+        depth.clear();
+        std::fill(objectId.begin(), objectId.end(), 0);
+        std::fill(materialId.begin(), materialId.end(), 0);
+    }
+
+    void serialize(std::ostream& out) const {
+        albedo.serialize(out);
+        normal.serialize(out);
+        depth.serialize(out);
+        out.write(reinterpret_cast<const char*>(objectId.data()), objectId.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char*>(materialId.data()), materialId.size() * sizeof(uint32_t));
+    }
+
+    bool deserialize(std::istream& in){
+        if(!albedo.deserialize(in) || !normal.deserialize(in) || !depth.deserialize(in))
+            return false;
+        in.read(reinterpret_cast<char*>(objectId.data()), objectId.size() * sizeof(uint32_t));
+        in.read(reinterpret_cast<char*>(materialId.data()), materialId.size() * sizeof(uint32_t));
+        return static_cast<bool>(in);
+    }
+};
+
+#endif //AOV_HPP
@@ -20,6 +20,14 @@ public:
     point3 cornerFarthest() const { return cornerFarthestZ; }
     void translate(const glm::vec3& translation) { cornerClosestZ += translation; cornerFarthestZ += translation; }
 
+    glm::vec3 extent() const { return cornerFarthestZ - cornerClosestZ; }
+    point3 centroid()  const { return 0.5f * (cornerClosestZ + cornerFarthestZ); }
+
+    float surfaceArea() const {
+        glm::vec3 size = extent();
+        return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+    }
+
     bool hit(const ray& r, double tMin, double tMax) const {
         for(int dimension = 0; dimension < 3; dimension++){
             double invD = 1.0f / r.direction()[dimension];
@@ -56,4 +64,8 @@ axisAlignedBoundingBox surroundingBox(const axisAlignedBoundingBox& box1, const
     return axisAlignedBoundingBox(cornerClosest, cornerFarthest);
 }
 
+axisAlignedBoundingBox surroundingBox(const axisAlignedBoundingBox& box, const point3& point) {
+    return surroundingBox(box, axisAlignedBoundingBox(point, point));
+}
+
 #endif //AXIS_ALIGNED_BOUNDING_BOX
\ No newline at end of file
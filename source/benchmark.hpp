@@ -0,0 +1,252 @@
+#ifndef BENCHMARK_HPP
+#define BENCHMARK_HPP
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include "rtweekend.hpp"
+#include "camera.hpp"
+#include "bvhNode.hpp"
+#include "bvh4.hpp"
+#include "scene.hpp"
+#include "wavefront.hpp"
+#include "sphereGroup.hpp"
+#include "sampler.hpp"
+#include "tileScheduler.hpp"
+#include "lights.hpp"
+
+const char* accelerationStructureName(accelerationStructure selection){
+    switch(selection){
+        case accelerationStructure::none: return "list";
+        case accelerationStructure::bvh2: return "bvh2";
+        case accelerationStructure::bvh4: return "bvh4";
+        case accelerationStructure::compiled: return "compiled";
+        case accelerationStructure::twoLevel: return "two level";
+        default:                          return "unknown";
+    }
+}
+
+//traces the same jittered primary rays through every acceleration structure, single threaded so the numbers are comparable
+void benchmarkAccelerationStructures(const std::vector<scene>& scenes, const bvhSettings& settings, int image_width = 400, int image_height = 400, int samplesPerPixel = 4){
+    samplesPerPixel = std::min(samplesPerPixel, rayPacket::width);
+    const char* sceneNames[] = { "randomBalls", "twoCheckeredSpheres", "twoPerlinSpheres", "earth", "spaceEarth", "cornellBox", "instanceTest", "instanceGrid" };
+
+    for(scene sceneSelection : scenes){
+        hittableList world;
+        point3 cameraPosition, cameraTarget, cameraUp;
+        color backgroundColor;
+        float vFov = 20;
+
+        setScene(sceneSelection, world, cameraPosition, cameraTarget, cameraUp, vFov, backgroundColor);
+        world = bakeTransforms(world);
+        camera worldCamera(cameraPosition, cameraTarget, cameraUp, vFov, float(image_width) / image_height, 0.0, 10.0, 0.0, 1.0);
+
+        //the last variant packs the spheres into sphereGroups before building the bvh over them
+        const std::pair<accelerationStructure, bool> variants[] = { { accelerationStructure::bvh2, false }, { accelerationStructure::bvh4, false },
+                                                                   { accelerationStructure::compiled, false }, { accelerationStructure::twoLevel, false },
+                                                                   { accelerationStructure::bvh2, true } };
+
+        for(const std::pair<accelerationStructure, bool>& variant : variants){
+            const accelerationStructure selection = variant.first;
+            const bool sphereGroups = variant.second;
+
+            auto buildStart = std::chrono::steady_clock::now();
+            std::shared_ptr<hittable> accelerated = buildAccelerationStructure(sphereGroups ? groupSpheres(world) : world, selection, settings);
+            std::chrono::duration<double, std::milli> buildTime = std::chrono::steady_clock::now() - buildStart;
+
+            sampler samples(samplerType::independent, 1234, samplesPerPixel);
+            int hitCount = 0;
+            auto traceStart = std::chrono::steady_clock::now();
+
+            for(int y = 0; y < image_height; y++){
+                for(int x = 0; x < image_width; x++){
+                    for(int s = 0; s < samplesPerPixel; s++){
+                        samples.startPixelSample(x, y, s);
+                        glm::vec2 pixelOffset = samples.get2D();
+                        float u = (x + pixelOffset.x) / (image_width - 1);
+                        float v = (y + pixelOffset.y) / (image_height - 1);
+                        hitRecord record;
+                        hitCount += accelerated->hit(worldCamera.getRay(u, v, samples), 0.001, infinity, record) ? 1 : 0;
+                    }
+                }
+            }
+
+            std::chrono::duration<double> traceTime = std::chrono::steady_clock::now() - traceStart;
+            double rayCount = double(image_width) * image_height * samplesPerPixel;
+
+            std::cerr << std::left << std::setw(14) << sceneNames[static_cast<int>(sceneSelection)]
+                      << std::setw(13) << (std::string(accelerationStructureName(selection)) + (sphereGroups ? " groups" : ""))
+                      << " build: " << std::setw(10) << buildTime.count() << " ms"
+                      << " | " << std::setw(10) << rayCount / traceTime.count() / 1e6 << " Mrays/s"
+                      << " | hits: " << hitCount << "\n" << std::flush;
+
+            if(selection != accelerationStructure::bvh2 || sphereGroups)
+                continue;
+
+            //same rays again, 8 neighbouring pixels per packet
+            hitCount = 0;
+            traceStart = std::chrono::steady_clock::now();
+
+            for(int y = 0; y < image_height; y++){
+                for(int x = 0; x < image_width; x += rayPacket::width){
+                    const int packetLanes = std::min(rayPacket::width, image_width - x);
+                    rayPacket packets[rayPacket::width];
+
+                    for(int lane = 0; lane < packetLanes; lane++){
+                        for(int s = 0; s < samplesPerPixel; s++){
+                            samples.startPixelSample(x + lane, y, s);
+                            glm::vec2 pixelOffset = samples.get2D();
+                            float u = (x + lane + pixelOffset.x) / (image_width - 1);
+                            float v = (y + pixelOffset.y) / (image_height - 1);
+                            packets[s].setRay(lane, worldCamera.getRay(u, v, samples));
+                        }
+                    }
+
+                    for(int s = 0; s < samplesPerPixel; s++){
+                        packets[s].finalize();
+                        float distMax[rayPacket::width];
+                        hitRecord records[rayPacket::width];
+                        std::fill(distMax, distMax + rayPacket::width, infinity);
+                        hitCount += laneCount(accelerated->hitPacket(packets[s], packets[s].laneMask, 0.001, distMax, records));
+                    }
+                }
+            }
+
+            traceTime = std::chrono::steady_clock::now() - traceStart;
+            std::cerr << std::left << std::setw(14) << sceneNames[static_cast<int>(sceneSelection)]
+                      << std::setw(13) << "bvh2 packets"
+                      << " build: " << std::setw(10) << buildTime.count() << " ms"
+                      << " | " << std::setw(10) << rayCount / traceTime.count() / 1e6 << " Mrays/s"
+                      << " | hits: " << hitCount << "\n" << std::flush;
+        }
+    }
+}
+
+//renders the same image with the recursive integrator and the wavefront integrator with and without ray reordering,
+//single threaded, prints camera samples per second and with BVH_STATS the bvh node fetches per ray
+void benchmarkRenderModes(const std::vector<scene>& scenes, const bvhSettings& settings, renderFunction recursiveRenderer, int image_width = 200, int image_height = 200, int samplesPerPixel = 16, int maxDepth = 10){
+    const char* sceneNames[] = { "randomBalls", "twoCheckeredSpheres", "twoPerlinSpheres", "earth", "spaceEarth", "cornellBox", "instanceTest", "instanceGrid" };
+
+    for(scene sceneSelection : scenes){
+        hittableList world;
+        point3 cameraPosition, cameraTarget, cameraUp;
+        color backgroundColor;
+        float vFov = 20;
+
+        setScene(sceneSelection, world, cameraPosition, cameraTarget, cameraUp, vFov, backgroundColor);
+        world = bakeTransforms(world);
+        camera worldCamera(cameraPosition, cameraTarget, cameraUp, vFov, float(image_width) / image_height, 0.0, 10.0, 0.0, 1.0);
+        #ifdef NEXT_EVENT_ESTIMATION
+        const lightList sceneLights(world);
+        #endif
+        hittableList acceleratedWorld(buildAccelerationStructure(world, accelerationStructure::bvh2, settings));
+
+        const char* modeNames[] = { "recursive", "wavefront", "wave sorted" };
+
+        renderSettings renderConfig;
+        renderConfig.image_width = image_width;
+        renderConfig.image_height = image_height;
+        renderConfig.pixelSampleCount = samplesPerPixel;
+        renderConfig.maxDepth = maxDepth;
+        renderConfig.backgroundColor = backgroundColor;
+        renderConfig.seed = 1234;
+        #ifdef NEXT_EVENT_ESTIMATION
+        renderConfig.lights = &sceneLights;
+        #endif
+        const imageTile wholeImage{ 0, 0, image_width, image_height };
+
+        for(int mode = 0; mode < 3; mode++){
+            framebuffer output(image_width, image_height);
+
+            #ifdef BVH_STATS
+            bvhStats = bvhTraversalStats();
+            #endif
+
+            auto renderStart = std::chrono::steady_clock::now();
+            if(mode == 0)
+                recursiveRenderer(wholeImage, renderConfig, output, nullptr, worldCamera, acceleratedWorld);
+            else
+                renderWaves(wholeImage, renderConfig, output, nullptr, worldCamera, acceleratedWorld, mode == 2);
+            std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+
+            double sampleCount = double(image_width) * image_height * samplesPerPixel;
+            std::cerr << std::left << std::setw(14) << sceneNames[static_cast<int>(sceneSelection)]
+                      << std::setw(13) << modeNames[mode]
+                      << " render: " << std::setw(10) << renderTime.count() << " s"
+                      << " | " << std::setw(10) << sampleCount / renderTime.count() / 1e6 << " Msamples/s";
+            #ifdef BVH_STATS
+            std::cerr << " | node fetches/ray: " << double(bvhStats.nodeFetches) / std::max<uint64_t>(1, bvhStats.rays);
+            #endif
+            std::cerr << "\n" << std::flush;
+        }
+    }
+}
+
+//renders every sampler at a low sample count and prints the rms error against a high sample count reference,
+//single threaded, the same seed is used for every sampler
+void benchmarkSamplers(const std::vector<scene>& scenes, const bvhSettings& settings, renderFunction renderer, int image_width = 100, int image_height = 100,
+                       int samplesPerPixel = 16, int referenceSamplesPerPixel = 1024, int maxDepth = 10){
+    const char* sceneNames[] = { "randomBalls", "twoCheckeredSpheres", "twoPerlinSpheres", "earth", "spaceEarth", "cornellBox", "instanceTest", "instanceGrid" };
+    const char* samplerNames[] = { "independent", "stratified", "sobol", "blue noise" };
+    const samplerType samplers[] = { samplerType::independent, samplerType::stratified, samplerType::sobol, samplerType::blueNoise };
+
+    for(scene sceneSelection : scenes){
+        hittableList world;
+        point3 cameraPosition, cameraTarget, cameraUp;
+        color backgroundColor;
+        float vFov = 20;
+
+        setScene(sceneSelection, world, cameraPosition, cameraTarget, cameraUp, vFov, backgroundColor);
+        world = bakeTransforms(world);
+        camera worldCamera(cameraPosition, cameraTarget, cameraUp, vFov, float(image_width) / image_height, 0.0, 10.0, 0.0, 1.0);
+        #ifdef NEXT_EVENT_ESTIMATION
+        const lightList sceneLights(world);
+        #endif
+        hittableList acceleratedWorld(buildAccelerationStructure(world, accelerationStructure::bvh2, settings));
+
+        renderSettings renderConfig;
+        renderConfig.image_width = image_width;
+        renderConfig.image_height = image_height;
+        renderConfig.pixelSampleCount = referenceSamplesPerPixel;
+        renderConfig.maxDepth = maxDepth;
+        renderConfig.backgroundColor = backgroundColor;
+        renderConfig.seed = 4321;
+        renderConfig.sampling = samplerType::sobol;
+        #ifdef NEXT_EVENT_ESTIMATION
+        renderConfig.lights = &sceneLights;
+        #endif
+        const imageTile wholeImage{ 0, 0, image_width, image_height };
+
+        framebuffer referenceOutput(image_width, image_height);
+        renderer(wholeImage, renderConfig, referenceOutput, nullptr, worldCamera, acceleratedWorld);
+        std::vector<uint8_t> reference;
+        referenceOutput.writeSDR(reference);
+
+        for(int i = 0; i < 4; i++){
+            renderConfig.pixelSampleCount = samplesPerPixel;
+            renderConfig.seed = 1234;
+            renderConfig.sampling = samplers[i];
+            framebuffer output(image_width, image_height);
+
+            auto renderStart = std::chrono::steady_clock::now();
+            renderer(wholeImage, renderConfig, output, nullptr, worldCamera, acceleratedWorld);
+            std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+
+            std::vector<uint8_t> imageBuffer;
+            output.writeSDR(imageBuffer);
+
+            double squaredError = 0.0;
+            for(size_t j = 0; j < imageBuffer.size(); j++){
+                double difference = double(imageBuffer[j]) - double(reference[j]);
+                squaredError += difference * difference;
+            }
+
+            std::cerr << std::left << std::setw(14) << sceneNames[static_cast<int>(sceneSelection)]
+                      << std::setw(13) << samplerNames[i]
+                      << " render: " << std::setw(10) << renderTime.count() << " s"
+                      << " | rmse: " << std::sqrt(squaredError / imageBuffer.size()) << " at " << samplesPerPixel << " spp\n" << std::flush;
+        }
+    }
+}
+
+#endif //BENCHMARK_HPP
@@ -0,0 +1,314 @@
+#ifndef BVH4_HPP
+#define BVH4_HPP
+
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "bvhNode.hpp"
+#include "compiledScene.hpp"
+#include "twoLevelBvh.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BVH4_SSE
+    #include <emmintrin.h>
+#endif
+
+enum class accelerationStructure{
+    none,
+    bvh2,
+    bvh4,
+    compiled,
+    twoLevel    //bvh over instances of shared per object bvhs
+};
+
+//four child boxes in SoA layout so one SIMD slab test covers all of them
+struct alignas(16) bvh4Node{
+    float boundsMinX[4];
+    float boundsMinY[4];
+    float boundsMinZ[4];
+    float boundsMaxX[4];
+    float boundsMaxY[4];
+    float boundsMaxZ[4];
+    uint32_t children[4];           //interior child: node index, leaf child: first primitive index
+    uint16_t primitiveCounts[4];    //0 for interior children
+    uint8_t childCount;
+    uint8_t padding[7];
+};
+
+class bvh4 : public hittable {
+private:
+    static const int maxStackSize = 256;
+
+    struct stackEntry{
+        uint32_t child;
+        uint32_t primitiveCount;
+        float distance;
+    };
+
+    std::vector<bvh4Node> nodes;
+    std::vector<const hittable*> primitives;
+    std::vector<std::shared_ptr<hittable>> objects;
+    axisAlignedBoundingBox rootBoundingBox;
+
+    uint32_t collapse(const std::vector<linearBvhNode>& binaryNodes, uint32_t binaryIndex);
+    int intersectChildren(const bvh4Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float distMin, float distMax, float childDistances[4]) const;
+
+public:
+    bvh4(){}
+
+    bvh4(const hittableList& list, float tStart = 0.0, float tEnd = 1.0, const bvhSettings& settings = bvhSettings());
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override;
+    virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override;
+
+    int nodeCount() const { return static_cast<int>(nodes.size()); }
+};
+
+bvh4::bvh4(const hittableList& list, float tStart, float tEnd, const bvhSettings& settings){
+    bvhNode binaryBvh(list, tStart, tEnd, settings);
+    if(!binaryBvh.boundingBox(tStart, tEnd, rootBoundingBox))
+        return;
+
+    primitives = binaryBvh.primitiveList();
+    objects = binaryBvh.objectList();
+
+    const std::vector<linearBvhNode>& binaryNodes = binaryBvh.linearNodes();
+    nodes.reserve(binaryNodes.size() / 2 + 1);
+
+    //a root leaf still needs an interior bvh4Node around it
+    if(binaryNodes[0].primitiveCount > 0){
+        bvh4Node root = bvh4Node();
+        for(int i = 0; i < 4; i++){
+            root.boundsMinX[i] = binaryNodes[0].boundsMin[0]; root.boundsMaxX[i] = binaryNodes[0].boundsMax[0];
+            root.boundsMinY[i] = binaryNodes[0].boundsMin[1]; root.boundsMaxY[i] = binaryNodes[0].boundsMax[1];
+            root.boundsMinZ[i] = binaryNodes[0].boundsMin[2]; root.boundsMaxZ[i] = binaryNodes[0].boundsMax[2];
+        }
+        root.children[0] = binaryNodes[0].offset;
+        root.primitiveCounts[0] = binaryNodes[0].primitiveCount;
+        root.childCount = 1;
+        nodes.push_back(root);
+        return;
+    }
+
+    collapse(binaryNodes, 0);
+}
+
+//pulls the grandchildren of the largest interior children up until the node has four children
+uint32_t bvh4::collapse(const std::vector<linearBvhNode>& binaryNodes, uint32_t binaryIndex){
+    auto surfaceArea = [&](uint32_t index){
+        const linearBvhNode& node = binaryNodes[index];
+        glm::vec3 size(node.boundsMax[0] - node.boundsMin[0], node.boundsMax[1] - node.boundsMin[1], node.boundsMax[2] - node.boundsMin[2]);
+        return size.x * size.y + size.y * size.z + size.z * size.x;
+    };
+
+    uint32_t children[4] = { binaryIndex + 1, binaryNodes[binaryIndex].offset, 0, 0 };
+    int childCount = 2;
+
+    while(childCount < 4){
+        int largest = -1;
+        float largestArea = -1.0f;
+        for(int i = 0; i < childCount; i++){
+            if(binaryNodes[children[i]].primitiveCount == 0 && surfaceArea(children[i]) > largestArea){
+                largest = i;
+                largestArea = surfaceArea(children[i]);
+            }
+        }
+
+        if(largest < 0)
+            break;
+
+        uint32_t expanded = children[largest];
+        children[largest] = expanded + 1;
+        children[childCount++] = binaryNodes[expanded].offset;
+    }
+
+    uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(bvh4Node());
+
+    bvh4Node node = bvh4Node();
+    node.childCount = static_cast<uint8_t>(childCount);
+
+    for(int i = 0; i < childCount; i++){
+        const linearBvhNode& child = binaryNodes[children[i]];
+        node.boundsMinX[i] = child.boundsMin[0]; node.boundsMaxX[i] = child.boundsMax[0];
+        node.boundsMinY[i] = child.boundsMin[1]; node.boundsMaxY[i] = child.boundsMax[1];
+        node.boundsMinZ[i] = child.boundsMin[2]; node.boundsMaxZ[i] = child.boundsMax[2];
+
+        if(child.primitiveCount > 0){
+            node.children[i] = child.offset;
+            node.primitiveCounts[i] = child.primitiveCount;
+        }
+        else{
+            node.children[i] = collapse(binaryNodes, children[i]);
+            node.primitiveCounts[i] = 0;
+        }
+    }
+
+    nodes[nodeIndex] = node;
+    return nodeIndex;
+}
+
+//returns a bitmask of the children whose box overlaps [distMin, distMax] and stores their entry distances
+inline int bvh4::intersectChildren(const bvh4Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float distMin, float distMax, float childDistances[4]) const {
+    const int validMask = (1 << node.childCount) - 1;
+
+#ifdef BVH4_SSE
+    const __m128 originX = _mm_set1_ps(origin.x);
+    const __m128 originY = _mm_set1_ps(origin.y);
+    const __m128 originZ = _mm_set1_ps(origin.z);
+    const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+    const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+    const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+
+    __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMinX), originX), inverseX);
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMaxX), originX), inverseX);
+    __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMinY), originY), inverseY);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMaxY), originY), inverseY);
+    __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMinZ), originZ), inverseZ);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.boundsMaxZ), originZ), inverseZ);
+
+    __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(distMin)));
+    __m128 tFar  = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(distMax)));
+
+    //widen the far distance slightly so rounding can't cull grazing hits on tiny primitives
+    tFar = _mm_mul_ps(tFar, _mm_set1_ps(1.0f + 4.0f * std::numeric_limits<float>::epsilon()));
+
+    _mm_storeu_ps(childDistances, tNear);
+    return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) & validMask;
+#else
+    int hitMask = 0;
+    for(int i = 0; i < node.childCount; i++){
+        const float boundsMin[3] = { node.boundsMinX[i], node.boundsMinY[i], node.boundsMinZ[i] };
+        const float boundsMax[3] = { node.boundsMaxX[i], node.boundsMaxY[i], node.boundsMaxZ[i] };
+        float tNear = distMin;
+        float tFar = distMax;
+
+        for(int dimension = 0; dimension < 3; dimension++){
+            float t0 = (boundsMin[dimension] - origin[dimension]) * inverseDirection[dimension];
+            float t1 = (boundsMax[dimension] - origin[dimension]) * inverseDirection[dimension];
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+
+        tFar *= 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+        childDistances[i] = tNear;
+        hitMask |= (tNear <= tFar) ? (1 << i) : 0;
+    }
+
+    return hitMask & validMask;
+#endif
+}
+
+bool bvh4::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
+    if(nodes.empty())
+        return false;
+
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+
+    stackEntry stack[maxStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0, distMin };
+    bool hitAnything = false;
+
+    while(stackSize > 0){
+        const stackEntry entry = stack[--stackSize];
+
+        //a closer hit found since this entry was pushed may have made it irrelevant
+        if(entry.distance > distMax)
+            continue;
+
+        if(entry.primitiveCount > 0){
+            for(uint32_t i = entry.child; i < entry.child + entry.primitiveCount; i++){
+                if(primitives[i]->intersect(r, distMin, distMax, query)){
+                    hitAnything = true;
+                    distMax = query.distance;
+                }
+            }
+            continue;
+        }
+
+        const bvh4Node& node = nodes[entry.child];
+        float childDistances[4];
+        int hitMask = intersectChildren(node, origin, inverseDirection, distMin, distMax, childDistances);
+
+        //push the hit children farthest first so the nearest one is popped next, insertion sorted straight onto the stack
+        const int stackBase = stackSize;
+        for(int i = 0; i < 4; i++){
+            if(!(hitMask & (1 << i)))
+                continue;
+
+            const stackEntry child = { node.children[i], node.primitiveCounts[i], childDistances[i] };
+            int slot = stackSize++;
+            while(slot > stackBase && stack[slot - 1].distance < child.distance){
+                stack[slot] = stack[slot - 1];
+                slot--;
+            }
+            stack[slot] = child;
+        }
+    }
+
+    return hitAnything;
+}
+
+//any hit traversal, hit children are pushed unsorted since the first primitive found ends the walk
+bool bvh4::occluded(const ray& r, float distMin, float distMax) const {
+    if(nodes.empty())
+        return false;
+
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+
+    stackEntry stack[maxStackSize];
+    int stackSize = 0;
+    stack[stackSize++] = { 0, 0, distMin };
+
+    while(stackSize > 0){
+        const stackEntry entry = stack[--stackSize];
+
+        if(entry.primitiveCount > 0){
+            for(uint32_t i = entry.child; i < entry.child + entry.primitiveCount; i++){
+                if(primitives[i]->occluded(r, distMin, distMax))
+                    return true;
+            }
+            continue;
+        }
+
+        const bvh4Node& node = nodes[entry.child];
+        float childDistances[4];
+        int hitMask = intersectChildren(node, origin, inverseDirection, distMin, distMax, childDistances);
+        for(int i = 0; i < 4; i++){
+            if(hitMask & (1 << i))
+                stack[stackSize++] = { node.children[i], node.primitiveCounts[i], childDistances[i] };
+        }
+    }
+
+    return false;
+}
+
+bool bvh4::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
+    if(nodes.empty())
+        return false;
+
+    refbox = rootBoundingBox;
+    return true;
+}
+
+std::shared_ptr<hittable> buildAccelerationStructure(const hittableList& world, accelerationStructure selection, const bvhSettings& settings, float tStart = 0.0, float tEnd = 1.0){
+    switch(selection){
+        case accelerationStructure::bvh2:
+            return std::make_shared<bvhNode>(world, tStart, tEnd, settings);
+        case accelerationStructure::bvh4:
+            return std::make_shared<bvh4>(world, tStart, tEnd, settings);
+        case accelerationStructure::compiled:
+            return std::make_shared<compiledScene>(world, tStart, tEnd, settings);
+        case accelerationStructure::twoLevel:
+            return std::make_shared<twoLevelBvh>(world, tStart, tEnd, settings);
+        default:
+            return std::make_shared<hittableList>(world);
+    }
+}
+
+#endif //BVH4_HPP
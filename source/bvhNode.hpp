@@ -11,51 +11,199 @@ enum class bvhAxis{
     x, y, z
 };
 
+enum class bvhSplitMethod{
+    median,
+    sah
+};
+
+struct bvhSettings{
+    bvhSplitMethod splitMethod = bvhSplitMethod::sah;
+    int binCount = 12;      //SAH candidate planes per axis are binCount - 1
+    int maxLeafSize = 4;    //nodes with more primitives are always split
+    float traversalCost = 1.0f;
+    float intersectionCost = 1.0f;
+    int threadCount = 1;                //build threads, shared out between subtree tasks as the tree splits
+    uint64_t parallelThreshold = 4096;  //smaller nodes are binned, partitioned and built on a single thread
+};
+
+//bounding box and centroid of every object are computed once up front instead of per comparison
+struct bvhPrimitive{
+    axisAlignedBoundingBox box;
+    point3 centroid;
+};
+
+struct bvhBin{
+    axisAlignedBoundingBox box;
+    int count = 0;
+
+    void add(const axisAlignedBoundingBox& primitiveBox){
+        box = count == 0 ? primitiveBox : surroundingBox(box, primitiveBox);
+        count++;
+    }
+
+    void add(const bvhBin& other){
+        if(other.count == 0)
+            return;
+
+        box = count == 0 ? other.box : surroundingBox(box, other.box);
+        count += other.count;
+    }
+};
+
+//the builder only ever reorders indices, the primitive array itself is read-only and shared by all build threads
+struct bvhBuildState{
+    const std::vector<bvhPrimitive>& primitives;
+    std::vector<uint32_t>& indices;
+    std::vector<uint32_t> scratch;
+    const bvhSettings& settings;
+};
+
+//32 byte depth first node: the left child of an interior node directly follows it in the node array
+struct linearBvhNode{
+    float boundsMin[3];
+    float boundsMax[3];
+    uint32_t offset;            //leaf: first primitive index, interior: index of the right child
+    uint16_t primitiveCount;    //0 for interior nodes
+    uint8_t axis;               //split axis, used to visit the nearer child first
+    uint8_t padding;
+};
+
+static_assert(sizeof(linearBvhNode) == 32, "linearBvhNode should stay 32 bytes");
+
+#ifdef BVH_STATS
+//per thread traversal counters, a packet visiting a node counts as one fetch for all of its lanes
+struct bvhTraversalStats{
+    uint64_t rays = 0;
+    uint64_t nodeFetches = 0;
+};
+
+inline thread_local bvhTraversalStats bvhStats;
+#endif
+
+inline bool hitNodeBox(const linearBvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float distMin, float distMax){
+    for(int dimension = 0; dimension < 3; dimension++){
+        float t0 = (node.boundsMin[dimension] - origin[dimension]) * inverseDirection[dimension];
+        float t1 = (node.boundsMax[dimension] - origin[dimension]) * inverseDirection[dimension];
+
+        if(inverseDirection[dimension] < 0.0f)
+            std::swap(t0, t1);
+
+        //widen the far distance slightly so rounding can't cull grazing hits on tiny primitives
+        t1 *= 1.0f + 4.0f * std::numeric_limits<float>::epsilon();
+
+        distMin = t0 > distMin ? t0 : distMin;
+        distMax = t1 < distMax ? t1 : distMax;
+
+        if(distMax <= distMin)
+            return false;
+    }
+
+    return true;
+}
+
 class bvhNode : public hittable {
-public:
-    std::shared_ptr<hittable> left;
-    std::shared_ptr<hittable> right;
-    axisAlignedBoundingBox nodeBoundingBox;
+private:
+    static const int maxTraversalDepth = 64;
+    static const int maxSahDepth = 40;      //deeper nodes fall back to median splits so the traversal stack can't overflow
 
+    std::vector<linearBvhNode> nodes;
+    std::vector<const hittable*> primitives;            //leaf ranges index into this array
+    std::vector<std::shared_ptr<hittable>> objects;     //keeps the primitives alive, never touched while tracing
+
+    static uint32_t buildRecursive(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, bvhAxis axis, int depth, int threadCount, std::vector<linearBvhNode>& outNodes);
+    static void rangeBounds(const bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, axisAlignedBoundingBox& parentBox, axisAlignedBoundingBox& centroidBox);
+    static uint64_t partitionRange(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, const std::function<bool(uint32_t)>& goesLeft);
+    static uint64_t splitMedian(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, bvhAxis axis);
+    static uint64_t splitSAH(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, const axisAlignedBoundingBox& parentBox, const axisAlignedBoundingBox& centroidBox, int& splitAxis);
+
+public:
     bvhNode(){}
 
-    bvhNode(const hittableList& list, float tStart = 0.0, float tEnd = 1.0):
-        bvhNode{list.objectList(), 0, static_cast<uint64_t>(list.objectList().size()), tStart, tEnd, bvhAxis::x}
-        {}
+    bvhNode(const hittableList& list, float tStart = 0.0, float tEnd = 1.0, const bvhSettings& settings = bvhSettings());
 
-    bvhNode(const std::vector<std::shared_ptr<hittable>> objectListConst, uint64_t listStart, uint64_t listEnd, float tStart, float tEnd, bvhAxis axis);
+    //packets with fewer active lanes than this are traced ray by ray
+    static const int minimumPacketLanes = 3;
 
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override;
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override;
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override;
-};
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override;
 
-inline bool boxCompare(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b, int axis){
-    axisAlignedBoundingBox boxA;
-    axisAlignedBoundingBox boxB;
+    //builds the node array over arbitrary primitive boxes, leaf ranges index into primitiveIndices which is filled in partitioned order
+    static std::vector<linearBvhNode> buildNodes(const std::vector<bvhPrimitive>& buildPrimitives, std::vector<uint32_t>& primitiveIndices, const bvhSettings& settings);
 
-    if(!a->boundingBox(0, 0, boxA) || !b->boundingBox(0, 0, boxB))
-        std::cerr << "No bounding box in bvhNode constructor.\n";
+    bool intersectSubtree(uint32_t rootIndex, const ray& r, float distMin, float distMax, hitQuery& query) const;
 
-    return boxA.cornerClosest()[axis] < boxB.cornerClosest()[axis];
-}
+    int nodeCount() const { return static_cast<int>(nodes.size()); }
+    const std::vector<linearBvhNode>& linearNodes() const { return nodes; }
+    const std::vector<const hittable*>& primitiveList() const { return primitives; }
+    const std::vector<std::shared_ptr<hittable>>& objectList() const { return objects; }
+};
 
-bool boxCompareX(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b){
-    return boxCompare(a, b, 0);
+inline int bvhBinIndex(float centroid, float axisMin, float binScale, int binCount){
+    return std::min(binCount - 1, static_cast<int>((centroid - axisMin) * binScale));
 }
 
-bool boxCompareY(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b){
-    return boxCompare(a, b, 1);
+std::vector<bvhPrimitive> bvhPrimitives(const hittableList& list, float tStart, float tEnd, int threadCount){
+    const std::vector<std::shared_ptr<hittable>>& objectList = list.objectList();
+    std::vector<bvhPrimitive> primitives(objectList.size());
+
+    parallelFor(0, objectList.size(), threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        for(uint64_t i = chunkBegin; i < chunkEnd; i++){
+            if(!objectList[i]->boundingBox(tStart, tEnd, primitives[i].box))
+                std::cerr << "No bounding box in bvhNode constructor.\n";
+
+            primitives[i].centroid = primitives[i].box.centroid();
+        }
+    });
+
+    return primitives;
 }
 
-bool boxCompareZ(const std::shared_ptr<hittable> a, const std::shared_ptr<hittable> b){
-    return boxCompare(a, b, 2);
+bvhNode::bvhNode(const hittableList& list, float tStart, float tEnd, const bvhSettings& settings){
+    const std::vector<std::shared_ptr<hittable>>& objectList = list.objectList();
+    if(objectList.empty())
+        return;
+
+    std::vector<bvhPrimitive> buildPrimitives = bvhPrimitives(list, tStart, tEnd, std::max(1, settings.threadCount));
+    std::vector<uint32_t> primitiveIndices;
+    nodes = buildNodes(buildPrimitives, primitiveIndices, settings);
+
+    //leaf ranges refer to the partitioned index order
+    objects = objectList;
+    primitives.reserve(primitiveIndices.size());
+    for(uint32_t primitiveIndex : primitiveIndices){
+        primitives.push_back(objectList[primitiveIndex].get());
+    }
 }
 
-bvhNode::bvhNode(const std::vector<std::shared_ptr<hittable>> objectListConst, uint64_t listStart, uint64_t listEnd, float tStart, float tEnd, bvhAxis axis){
-    std::vector<std::shared_ptr<hittable>> objectList = objectListConst;
+std::vector<linearBvhNode> bvhNode::buildNodes(const std::vector<bvhPrimitive>& buildPrimitives, std::vector<uint32_t>& primitiveIndices, const bvhSettings& settings){
+    //leaf sizes have to fit in linearBvhNode::primitiveCount
+    bvhSettings buildSettings = settings;
+    buildSettings.maxLeafSize = std::max(1, std::min(settings.maxLeafSize, static_cast<int>(std::numeric_limits<uint16_t>::max())));
+    buildSettings.threadCount = std::max(1, settings.threadCount);
+
+    primitiveIndices.resize(buildPrimitives.size());
+    for(uint32_t i = 0; i < primitiveIndices.size(); i++){
+        primitiveIndices[i] = i;
+    }
+
+    std::vector<linearBvhNode> outNodes;
+    if(buildPrimitives.empty())
+        return outNodes;
 
+    bvhBuildState state{buildPrimitives, primitiveIndices, std::vector<uint32_t>(), buildSettings};
+    if(buildSettings.threadCount > 1)
+        state.scratch.resize(primitiveIndices.size());
+
+    outNodes.reserve(2 * buildPrimitives.size());
+    buildRecursive(state, 0, static_cast<uint64_t>(buildPrimitives.size()), bvhAxis::x, 0, buildSettings.threadCount, outNodes);
+    return outNodes;
+}
+
+uint32_t bvhNode::buildRecursive(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, bvhAxis axis, int depth, int threadCount, std::vector<linearBvhNode>& outNodes){
+    const bvhSettings& settings = state.settings;
     bvhAxis nextAxis;
-    auto comparator = boxCompareX;
 
     switch(axis){
         case bvhAxis::x:
@@ -63,60 +211,456 @@ bvhNode::bvhNode(const std::vector<std::shared_ptr<hittable>> objectListConst, u
             break;
         case bvhAxis::y:
             nextAxis = bvhAxis::z;
-            boxCompareY;
             break;
         case bvhAxis::z:
             nextAxis = bvhAxis::x;
-            boxCompareZ;
             break;
     }
 
     uint64_t listLength = listEnd - listStart;
+    if(listLength < settings.parallelThreshold)
+        threadCount = 1;
+
+    axisAlignedBoundingBox nodeBoundingBox, centroidBox;
+    rangeBounds(state, listStart, listEnd, threadCount, nodeBoundingBox, centroidBox);
+
+    uint64_t middle = listEnd;
+    int splitAxis = static_cast<int>(axis);
 
-    if(listLength == 1){
-        left = objectList[listStart];
-        right = left;
+    if(settings.splitMethod == bvhSplitMethod::sah && depth < maxSahDepth && listLength > 1)
+        middle = splitSAH(state, listStart, listEnd, threadCount, nodeBoundingBox, centroidBox, splitAxis);
+    else if(static_cast<int>(listLength) > settings.maxLeafSize)
+        middle = splitMedian(state, listStart, listEnd, axis);
+
+    uint32_t nodeIndex = static_cast<uint32_t>(outNodes.size());
+    outNodes.push_back(linearBvhNode());
+
+    linearBvhNode node;
+    for(int dimension = 0; dimension < 3; dimension++){
+        node.boundsMin[dimension] = nodeBoundingBox.cornerClosest()[dimension];
+        node.boundsMax[dimension] = nodeBoundingBox.cornerFarthest()[dimension];
     }
-    else if(listLength == 2){
-        if(comparator(objectList[listStart], objectList[listEnd - 1])){
-            left = objectList[listStart];
-            right = objectList[listEnd - 1];
-        }
-        else{
-            left = objectList[listEnd - 1];
-            right = objectList[listStart];
+    node.axis = static_cast<uint8_t>(splitAxis);
+    node.padding = 0;
+
+    if(middle == listStart || middle == listEnd){
+        node.offset = static_cast<uint32_t>(listStart);
+        node.primitiveCount = static_cast<uint16_t>(listLength);
+    }
+    else if(threadCount > 1){
+        //build the right subtree into its own array on another thread and splice it in behind the left subtree
+        int leftThreadCount = threadCount / 2;
+        std::vector<linearBvhNode> rightNodes;
+        std::thread rightTask([&](){
+            buildRecursive(state, middle, listEnd, nextAxis, depth + 1, threadCount - leftThreadCount, rightNodes);
+        });
+
+        buildRecursive(state, listStart, middle, nextAxis, depth + 1, leftThreadCount, outNodes);
+        rightTask.join();
+
+        uint32_t rightBase = static_cast<uint32_t>(outNodes.size());
+        for(linearBvhNode& rightNode : rightNodes){
+            if(rightNode.primitiveCount == 0)
+                rightNode.offset += rightBase;
         }
+
+        outNodes.insert(outNodes.end(), rightNodes.begin(), rightNodes.end());
+        node.offset = rightBase;
+        node.primitiveCount = 0;
     }
     else{
-        std::sort(objectList.begin() + listStart, objectList.begin() + listEnd, comparator);
+        buildRecursive(state, listStart, middle, nextAxis, depth + 1, 1, outNodes);
+        node.offset = buildRecursive(state, middle, listEnd, nextAxis, depth + 1, 1, outNodes);
+        node.primitiveCount = 0;
+    }
 
-        int middle = listStart + listLength / 2;
-        left = std::make_shared<bvhNode>(objectListConst, listStart, middle, tStart, tEnd, nextAxis);
-        right = std::make_shared<bvhNode>(objectListConst, middle, listEnd, tStart, tEnd, nextAxis);
+    outNodes[nodeIndex] = node;
+    return nodeIndex;
+}
+
+void bvhNode::rangeBounds(const bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, axisAlignedBoundingBox& parentBox, axisAlignedBoundingBox& centroidBox){
+    std::vector<axisAlignedBoundingBox> chunkBoxes(std::max(1, threadCount));
+    std::vector<axisAlignedBoundingBox> chunkCentroidBoxes(std::max(1, threadCount));
+    std::vector<char> chunkUsed(std::max(1, threadCount), false);
+
+    parallelFor(listStart, listEnd, threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        if(chunkBegin == chunkEnd)
+            return;
+
+        const bvhPrimitive& first = state.primitives[state.indices[chunkBegin]];
+        axisAlignedBoundingBox box = first.box;
+        axisAlignedBoundingBox centroids(first.centroid, first.centroid);
+
+        for(uint64_t i = chunkBegin + 1; i < chunkEnd; i++){
+            const bvhPrimitive& primitive = state.primitives[state.indices[i]];
+            box = surroundingBox(box, primitive.box);
+            centroids = surroundingBox(centroids, primitive.centroid);
+        }
+
+        chunkBoxes[chunkIndex] = box;
+        chunkCentroidBoxes[chunkIndex] = centroids;
+        chunkUsed[chunkIndex] = true;
+    });
+
+    parentBox = chunkBoxes[0];
+    centroidBox = chunkCentroidBoxes[0];
+    for(int chunk = 1; chunk < static_cast<int>(chunkBoxes.size()); chunk++){
+        if(!chunkUsed[chunk])
+            continue;
+
+        parentBox = surroundingBox(parentBox, chunkBoxes[chunk]);
+        centroidBox = surroundingBox(centroidBox, chunkCentroidBoxes[chunk]);
+    }
+}
+
+//stable two pass partition through the scratch array when several threads are available, std::partition otherwise
+uint64_t bvhNode::partitionRange(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, const std::function<bool(uint32_t)>& goesLeft){
+    if(threadCount <= 1){
+        auto middle = std::partition(state.indices.begin() + listStart, state.indices.begin() + listEnd, goesLeft);
+        return static_cast<uint64_t>(middle - state.indices.begin());
     }
 
-    axisAlignedBoundingBox leftBox, rightBox;
+    std::vector<uint64_t> chunkLeftCounts(threadCount, 0);
+    std::vector<uint64_t> chunkRightCounts(threadCount, 0);
+
+    parallelFor(listStart, listEnd, threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        uint64_t leftCount = 0;
+        for(uint64_t i = chunkBegin; i < chunkEnd; i++){
+            leftCount += goesLeft(state.indices[i]) ? 1 : 0;
+        }
+
+        chunkLeftCounts[chunkIndex] = leftCount;
+        chunkRightCounts[chunkIndex] = (chunkEnd - chunkBegin) - leftCount;
+    });
 
-    if(!left->boundingBox(tStart, tEnd, leftBox) || !right->boundingBox(tStart, tEnd, rightBox)){
-        std::cerr << "No bounding box in bvhNode constructor.\n";
+    uint64_t totalLeft = 0;
+    for(uint64_t leftCount : chunkLeftCounts){
+        totalLeft += leftCount;
     }
 
-    nodeBoundingBox = surroundingBox(leftBox, rightBox);
+    //each chunk writes its left and right primitives behind the ones of the chunks before it
+    std::vector<uint64_t> leftOffsets(threadCount), rightOffsets(threadCount);
+    uint64_t leftOffset = listStart;
+    uint64_t rightOffset = listStart + totalLeft;
+    for(int chunk = 0; chunk < threadCount; chunk++){
+        leftOffsets[chunk] = leftOffset;
+        rightOffsets[chunk] = rightOffset;
+        leftOffset += chunkLeftCounts[chunk];
+        rightOffset += chunkRightCounts[chunk];
+    }
+
+    parallelFor(listStart, listEnd, threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        uint64_t left = leftOffsets[chunkIndex];
+        uint64_t right = rightOffsets[chunkIndex];
+        for(uint64_t i = chunkBegin; i < chunkEnd; i++){
+            uint32_t primitiveIndex = state.indices[i];
+            state.scratch[goesLeft(primitiveIndex) ? left++ : right++] = primitiveIndex;
+        }
+    });
+
+    parallelFor(listStart, listEnd, threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        std::copy(state.scratch.begin() + chunkBegin, state.scratch.begin() + chunkEnd, state.indices.begin() + chunkBegin);
+    });
+
+    return listStart + totalLeft;
 }
 
-bool bvhNode::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
-    if(!nodeBoundingBox.hit(r, distMin, distMax))
+uint64_t bvhNode::splitMedian(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, bvhAxis axis){
+    int dimension = static_cast<int>(axis);
+    const std::vector<bvhPrimitive>& buildPrimitives = state.primitives;
+
+    uint64_t middle = listStart + (listEnd - listStart) / 2;
+    std::nth_element(state.indices.begin() + listStart, state.indices.begin() + middle, state.indices.begin() + listEnd, [&](uint32_t a, uint32_t b){
+        return buildPrimitives[a].box.cornerClosest()[dimension] < buildPrimitives[b].box.cornerClosest()[dimension];
+    });
+
+    return middle;
+}
+
+//Binned Surface Area Heuristic: returns the partition index or listEnd when a leaf is cheaper than any split
+uint64_t bvhNode::splitSAH(bvhBuildState& state, uint64_t listStart, uint64_t listEnd, int threadCount, const axisAlignedBoundingBox& parentBox, const axisAlignedBoundingBox& centroidBox, int& splitAxis){
+    const bvhSettings& settings = state.settings;
+    const std::vector<bvhPrimitive>& buildPrimitives = state.primitives;
+    uint64_t listLength = listEnd - listStart;
+    const int binCount = std::max(2, settings.binCount);
+
+    glm::vec3 centroidExtent = centroidBox.extent();
+    splitAxis = 0;
+    if(centroidExtent.y > centroidExtent[splitAxis]) splitAxis = 1;
+    if(centroidExtent.z > centroidExtent[splitAxis]) splitAxis = 2;
+
+    //all centroids coincide, binning can't separate them
+    if(centroidExtent[splitAxis] <= 0.0f){
+        if(static_cast<int>(listLength) <= settings.maxLeafSize)
+            return listEnd;
+
+        return listStart + listLength / 2;
+    }
+
+    glm::vec3 axisMin = centroidBox.cornerClosest();
+    glm::vec3 binScale;
+    for(int axis = 0; axis < 3; axis++){
+        binScale[axis] = centroidExtent[axis] > 0.0f ? binCount / centroidExtent[axis] : 0.0f;
+    }
+
+    //all three axes are binned in one pass, every chunk fills its own bins which are merged afterwards
+    std::vector<std::vector<bvhBin>> chunkBins(std::max(1, threadCount), std::vector<bvhBin>(3 * binCount));
+    parallelFor(listStart, listEnd, threadCount, [&](uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex){
+        std::vector<bvhBin>& bins = chunkBins[chunkIndex];
+        for(uint64_t i = chunkBegin; i < chunkEnd; i++){
+            const bvhPrimitive& primitive = buildPrimitives[state.indices[i]];
+            for(int axis = 0; axis < 3; axis++){
+                bins[axis * binCount + bvhBinIndex(primitive.centroid[axis], axisMin[axis], binScale[axis], binCount)].add(primitive.box);
+            }
+        }
+    });
+
+    std::vector<bvhBin>& bins = chunkBins[0];
+    for(int chunk = 1; chunk < static_cast<int>(chunkBins.size()); chunk++){
+        for(int i = 0; i < 3 * binCount; i++){
+            bins[i].add(chunkBins[chunk][i]);
+        }
+    }
+
+    float bestCost = infinity;
+    int bestAxis = -1;
+    int bestBin = 0;
+    float parentArea = parentBox.surfaceArea();
+    std::vector<float> costs(binCount - 1);
+
+    for(int axis = 0; axis < 3; axis++){
+        if(centroidExtent[axis] <= 0.0f)
+            continue;
+
+        const bvhBin* axisBins = &bins[axis * binCount];
+
+        //sweep from the left storing area * count, then from the right adding the other half
+        bvhBin sweep;
+        for(int i = 0; i < binCount - 1; i++){
+            sweep.add(axisBins[i]);
+            costs[i] = sweep.count == 0 ? infinity : sweep.count * sweep.box.surfaceArea();
+        }
+
+        sweep = bvhBin();
+        for(int i = binCount - 1; i > 0; i--){
+            sweep.add(axisBins[i]);
+            costs[i - 1] = sweep.count == 0 ? infinity : costs[i - 1] + sweep.count * sweep.box.surfaceArea();
+        }
+
+        for(int i = 0; i < binCount - 1; i++){
+            if(costs[i] < bestCost){
+                bestCost = costs[i];
+                bestAxis = axis;
+                bestBin = i;
+            }
+        }
+    }
+
+    float leafCost = settings.intersectionCost * listLength;
+    float splitCost = settings.traversalCost + settings.intersectionCost * bestCost / parentArea;
+
+    if(bestAxis < 0 || (splitCost >= leafCost && static_cast<int>(listLength) <= settings.maxLeafSize))
+        return listEnd;
+
+    splitAxis = bestAxis;
+    float splitMin = axisMin[bestAxis];
+    float splitScale = binScale[bestAxis];
+
+    return partitionRange(state, listStart, listEnd, threadCount, [&](uint32_t primitiveIndex){
+        return bvhBinIndex(buildPrimitives[primitiveIndex].centroid[bestAxis], splitMin, splitScale, binCount) <= bestBin;
+    });
+}
+
+bool bvhNode::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
+    if(nodes.empty())
         return false;
-    
-    bool hitLeft = left->hit(r, distMin, distMax, record);
-    bool hitRight = right->hit(r, distMin, hitLeft ? record.distance : distMax, record);
 
-    return hitLeft || hitRight;
+    #ifdef BVH_STATS
+    bvhStats.rays++;
+    #endif
+
+    return intersectSubtree(0, r, distMin, distMax, query);
+}
+
+bool bvhNode::intersectSubtree(uint32_t rootIndex, const ray& r, float distMin, float distMax, hitQuery& query) const {
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+    const bool directionNegative[3] = { inverseDirection.x < 0.0f, inverseDirection.y < 0.0f, inverseDirection.z < 0.0f };
+
+    uint32_t nodeStack[maxTraversalDepth];
+    int stackSize = 0;
+    uint32_t nodeIndex = rootIndex;
+    bool hitAnything = false;
+
+    while(true){
+        const linearBvhNode& node = nodes[nodeIndex];
+
+        #ifdef BVH_STATS
+        bvhStats.nodeFetches++;
+        #endif
+
+        if(hitNodeBox(node, origin, inverseDirection, distMin, distMax)){
+            if(node.primitiveCount > 0){
+                for(uint32_t i = node.offset; i < node.offset + node.primitiveCount; i++){
+                    if(primitives[i]->intersect(r, distMin, distMax, query)){
+                        hitAnything = true;
+                        distMax = query.distance;
+                    }
+                }
+
+                if(stackSize == 0)
+                    break;
+                nodeIndex = nodeStack[--stackSize];
+            }
+            else if(directionNegative[node.axis]){
+                //right child is nearer, postpone the left child
+                nodeStack[stackSize++] = nodeIndex + 1;
+                nodeIndex = node.offset;
+            }
+            else{
+                nodeStack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+            }
+        }
+        else{
+            if(stackSize == 0)
+                break;
+            nodeIndex = nodeStack[--stackSize];
+        }
+    }
+
+    return hitAnything;
+}
+
+//any hit traversal: the interval never shrinks and the first primitive found in it ends the walk, so the child order does not matter
+bool bvhNode::occluded(const ray& r, float distMin, float distMax) const {
+    if(nodes.empty())
+        return false;
+
+    #ifdef BVH_STATS
+    bvhStats.rays++;
+    #endif
+
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+
+    uint32_t nodeStack[maxTraversalDepth];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    while(true){
+        const linearBvhNode& node = nodes[nodeIndex];
+
+        #ifdef BVH_STATS
+        bvhStats.nodeFetches++;
+        #endif
+
+        if(hitNodeBox(node, origin, inverseDirection, distMin, distMax)){
+            if(node.primitiveCount > 0){
+                for(uint32_t i = node.offset; i < node.offset + node.primitiveCount; i++){
+                    if(primitives[i]->occluded(r, distMin, distMax))
+                        return true;
+                }
+            }
+            else{
+                nodeStack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+        }
+
+        if(stackSize == 0)
+            return false;
+        nodeIndex = nodeStack[--stackSize];
+    }
+}
+
+//packet traversal: the interval test culls nodes for the whole packet, surviving nodes get an exact per lane test
+//and lanes drop out of the active mask as they miss, once too few are left the subtree is traced ray by ray
+int bvhNode::hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const {
+    if(nodes.empty())
+        return 0;
+
+    if(!packet.coherent || laneCount(activeMask) < minimumPacketLanes)
+        return hittable::hitPacket(packet, activeMask, distMin, distMax, records);
+
+    struct stackEntry{
+        uint32_t nodeIndex;
+        int laneMask;
+    };
+
+    #ifdef BVH_STATS
+    bvhStats.rays += laneCount(activeMask);
+    #endif
+
+    int firstLane = 0;
+    while(!(activeMask & (1 << firstLane))) firstLane++;
+    const bool directionNegative[3] = { packet.inverseX[firstLane] < 0.0f, packet.inverseY[firstLane] < 0.0f, packet.inverseZ[firstLane] < 0.0f };
+
+    stackEntry nodeStack[maxTraversalDepth];
+    int stackSize = 0;
+    nodeStack[stackSize++] = { 0, activeMask };
+    int hitMask = 0;
+
+    while(stackSize > 0){
+        const stackEntry entry = nodeStack[--stackSize];
+        const linearBvhNode& node = nodes[entry.nodeIndex];
+
+        #ifdef BVH_STATS
+        bvhStats.nodeFetches++;
+        #endif
+
+        float packetDistMax = 0.0f;
+        for(int lane = 0; lane < rayPacket::width; lane++){
+            if(entry.laneMask & (1 << lane))
+                packetDistMax = std::max(packetDistMax, distMax[lane]);
+        }
+
+        if(!packet.intervalHitsBox(node.boundsMin, node.boundsMax, distMin, packetDistMax))
+            continue;
+
+        int laneMask = packet.lanesHitBox(node.boundsMin, node.boundsMax, distMin, distMax, entry.laneMask);
+        if(laneMask == 0)
+            continue;
+
+        //the packet has diverged, finish this subtree with single rays
+        if(laneCount(laneMask) < minimumPacketLanes){
+            for(int lane = 0; lane < rayPacket::width; lane++){
+                hitQuery query;
+                if((laneMask & (1 << lane)) && intersectSubtree(entry.nodeIndex, packet.rays[lane], distMin, distMax[lane], query)){
+                    finalizeHit(packet.rays[lane], query, records[lane]);
+                    distMax[lane] = query.distance;
+                    hitMask |= 1 << lane;
+                }
+            }
+            continue;
+        }
+
+        if(node.primitiveCount > 0){
+            for(uint32_t i = node.offset; i < node.offset + node.primitiveCount; i++){
+                hitMask |= primitives[i]->hitPacket(packet, laneMask, distMin, distMax, records);
+            }
+        }
+        else if(directionNegative[node.axis]){
+            nodeStack[stackSize++] = { entry.nodeIndex + 1, laneMask };
+            nodeStack[stackSize++] = { node.offset, laneMask };
+        }
+        else{
+            nodeStack[stackSize++] = { node.offset, laneMask };
+            nodeStack[stackSize++] = { entry.nodeIndex + 1, laneMask };
+        }
+    }
+
+    return hitMask;
 }
 
 bool bvhNode::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
-    refbox = nodeBoundingBox;
+    if(nodes.empty())
+        return false;
+
+    refbox = axisAlignedBoundingBox(point3(nodes[0].boundsMin[0], nodes[0].boundsMin[1], nodes[0].boundsMin[2]),
+                                    point3(nodes[0].boundsMax[0], nodes[0].boundsMax[1], nodes[0].boundsMax[2]));
     return true;
 }
 
-#endif //BVH_NODE
\ No newline at end of file
+#endif //BVH_NODE
@@ -1,6 +1,8 @@
 #ifndef CAMERA_HPP
 #define CAMERA_HPP
 
+#include "sampler.hpp"
+
 class camera{
 private:
     point3 origin;
@@ -48,11 +50,13 @@ public:
         lowerLeftCorner = origin - horizontal * 0.5f - vertical * 0.5f - glm::vec3(0, 0, focalLength);
     }
 
-    ray getRay(float x, float y, std::mt19937& rng) const {
-        glm::vec3 lensPosition = lensRadius * randomInUnitDisk();
+    //draws the lens and time dimensions, the pixel position x, y is picked by the caller
+    ray getRay(float x, float y, sampler& samples) const {
+        glm::vec2 lensPosition = lensRadius * squareToConcentricDisk(samples.get2D());
         glm::vec3 lensPositionOffset = u * lensPosition.x + v * lensPosition.y;
+        float time = exposureStart + (exposureEnd - exposureStart) * samples.get1D();
 
-        return ray(origin + lensPositionOffset, lowerLeftCorner + x*horizontal + y*vertical - origin - lensPositionOffset, randomFloat(rng, exposureStart, exposureEnd));
+        return ray(origin + lensPositionOffset, lowerLeftCorner + x*horizontal + y*vertical - origin - lensPositionOffset, time);
     }
 
 };
@@ -0,0 +1,111 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include "rtweekend.hpp"
+#include "sampler.hpp"
+#include "framebuffer.hpp"
+#include "aov.hpp"
+
+//everything a progressive render needs to continue: the sample sequence of every pixel is keyed by the render seed, so seed,
+//sampler and the samples per pixel reached replace the generator state. The accumulation buffers follow the header as raw floats.
+//The render fields identify what was rendered, a checkpoint is only continued by a render that matches them
+struct checkpointHeader{
+    char magic[8] = { 'R', 'T', 'C', 'K', 'P', 'T', '\0', '\0' };
+    uint32_t version = 2;
+    int32_t image_width = 0;
+    int32_t image_height = 0;
+    uint32_t sampling = 0;
+    uint64_t seed = 0;
+    int32_t sampleCount = 0;
+    int32_t hasAovs = 0;
+
+    //render fields
+    uint32_t scene = 0;
+    uint32_t integrator = 0;
+    int32_t maxDepth = 0;
+    int32_t russianRouletteDepth = 0;
+    int32_t targetSampleCount = 0;
+};
+
+inline bool sameRender(const checkpointHeader& a, const checkpointHeader& b){
+    return a.image_width == b.image_width && a.image_height == b.image_height && a.scene == b.scene && a.integrator == b.integrator &&
+           a.maxDepth == b.maxDepth && a.russianRouletteDepth == b.russianRouletteDepth && a.targetSampleCount == b.targetSampleCount;
+}
+
+//writes to a temporary file first and renames it, a render killed while writing keeps its previous checkpoint
+inline bool writeCheckpoint(const std::string& path, const checkpointHeader& header, const framebuffer& beauty, const aovBuffers* aovs){
+    const std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+        if(!out)
+            return false;
+
+        checkpointHeader written = header;
+        written.hasAovs = aovs ? 1 : 0;
+        out.write(reinterpret_cast<const char*>(&written), sizeof(written));
+        beauty.serialize(out);
+        if(aovs)
+            aovs->serialize(out);
+
+        if(!out)
+            return false;
+    }
+
+    //rename replaces the old checkpoint in one step where it can, only where it refuses to overwrite (windows) the old one is
+    //removed first and the temporary file is the checkpoint until the second rename, readCheckpoint falls back to it
+    if(std::rename(temporaryPath.c_str(), path.c_str()) == 0)
+        return true;
+    std::remove(path.c_str());
+    return std::rename(temporaryPath.c_str(), path.c_str()) == 0;
+}
+
+//a finished render leaves nothing to continue
+inline void removeCheckpoint(const std::string& path){
+    std::remove(path.c_str());
+    std::remove((path + ".tmp").c_str());
+}
+
+//loads a checkpoint of the render described by header into the buffers, returns false and leaves the header untouched
+//when there is none or it is of a different render. Aovs missing from the checkpoint stay empty
+inline bool readCheckpoint(const std::string& path, checkpointHeader& header, framebuffer& beauty, aovBuffers* aovs){
+    std::ifstream in(path, std::ios::binary);
+    if(!in)
+        in.open(path + ".tmp", std::ios::binary);
+    if(!in)
+        return false;
+
+    checkpointHeader loaded;
+    const checkpointHeader expected;
+    in.read(reinterpret_cast<char*>(&loaded), sizeof(loaded));
+    if(!in || std::memcmp(loaded.magic, expected.magic, sizeof(expected.magic)) != 0 || loaded.version != expected.version){
+        std::cerr << "Checkpoint " << path << " is not a checkpoint of this version, ignored\n" << std::flush;
+        return false;
+    }
+    if(loaded.image_width != beauty.getWidth() || loaded.image_height != beauty.getHeight()){
+        std::cerr << "Checkpoint " << path << " is " << loaded.image_width << "x" << loaded.image_height << ", ignored\n" << std::flush;
+        return false;
+    }
+    if(!sameRender(loaded, header)){
+        std::cerr << "Checkpoint " << path << " is of a different scene or render settings, ignored\n" << std::flush;
+        return false;
+    }
+
+    if(!beauty.deserialize(in)){
+        beauty.clear();
+        return false;
+    }
+    if(aovs && loaded.hasAovs && !aovs->deserialize(in)){
+        beauty.clear();
+        aovs->clear();
+        return false;
+    }
+
+    header = loaded;
+    return true;
+}
+
+#endif //CHECKPOINT_HPP
@@ -0,0 +1,534 @@
+#ifndef COMPILED_SCENE_HPP
+#define COMPILED_SCENE_HPP
+
+#include <unordered_map>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "sphere.hpp"
+#include "rectangle.hpp"
+#include "bvhNode.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define COMPILED_SCENE_SSE
+    #include <emmintrin.h>
+#endif
+
+enum class compiledPrimitiveType : uint32_t{
+    sphere,
+    rectangle,
+    generic
+};
+
+//all spheres of the scene in SoA layout, the float arrays are padded by three entries so the SIMD kernel can always load four
+struct compiledSpheres{
+    std::vector<float> centerX, centerY, centerZ;          //center at time 0
+    std::vector<float> velocityX, velocityY, velocityZ;    //center movement per unit of time
+    std::vector<float> radius;
+    std::vector<uint32_t> materialIndex;
+    std::vector<uint32_t> objectId;         //id of the source hittable, the compiled copy reports the same id
+};
+
+//axis aligned rectangles of all three orientations, constAxis is the plane normal, axisA and axisB the in-plane axes
+struct compiledRectangles{
+    std::vector<uint8_t> constAxis, axisA, axisB;
+    std::vector<float> constValue;
+    std::vector<float> minA, maxA, minB, maxB;
+    std::vector<float> startTime, inverseDuration;
+    std::vector<glm::vec3> displacement;
+    std::vector<uint32_t> materialIndex;
+    std::vector<uint32_t> objectId;
+};
+
+//closed representation of a hittableList for tracing: spheres and rectangles live in per type arrays and bvh leaves reference
+//them by typed index, so the hot loop needs no virtual calls. Everything else (instances, media, ...) stays a generic hittable
+class compiledScene : public hittable {
+private:
+    static const int maxTraversalDepth = 64;
+    static const uint32_t typeShift = 30;
+    static const uint32_t indexMask = (1u << typeShift) - 1;
+
+    std::vector<linearBvhNode> nodes;
+    std::vector<uint32_t> references;   //primitive type in the top two bits, index into that type's arrays below
+
+    compiledSpheres spheres;
+    compiledRectangles rectangles;
+    std::vector<const hittable*> generics;
+
+    std::vector<std::shared_ptr<material>> materials;
+    std::vector<std::shared_ptr<hittable>> objects;     //keeps the authoring objects alive
+
+    static uint32_t makeReference(compiledPrimitiveType type, uint32_t index) { return (static_cast<uint32_t>(type) << typeShift) | index; }
+    static compiledPrimitiveType referenceType(uint32_t reference) { return static_cast<compiledPrimitiveType>(reference >> typeShift); }
+
+    void flatten(const std::shared_ptr<hittable>& object, std::vector<compiledPrimitiveType>& types);
+    uint32_t materialIndex(const std::shared_ptr<material>& surfaceMaterial, std::unordered_map<const material*, uint32_t>& materialLookup);
+    void appendSphere(const sphere& object, std::unordered_map<const material*, uint32_t>& materialLookup);
+    void appendRectangle(const hittable& object, std::unordered_map<const material*, uint32_t>& materialLookup);
+
+    bool hitSpheres(uint32_t first, uint32_t count, const ray& r, float distMin, float distMax, float& hitDistance, uint32_t& hitIndex) const;
+    bool hitRectangle(uint32_t index, const ray& r, float distMin, float distMax, float& hitDistance) const;
+
+public:
+    compiledScene(){}
+
+    compiledScene(const hittableList& list, float tStart = 0.0, float tEnd = 1.0, const bvhSettings& settings = bvhSettings());
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override;
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override;
+    virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override;
+
+    size_t sphereCount() const { return spheres.materialIndex.size(); }
+    size_t rectangleCount() const { return rectangles.materialIndex.size(); }
+    size_t genericCount() const { return generics.size(); }
+};
+
+compiledScene::compiledScene(const hittableList& list, float tStart, float tEnd, const bvhSettings& settings){
+    std::vector<compiledPrimitiveType> types;
+    for(const std::shared_ptr<hittable>& object : list.objectList()){
+        flatten(object, types);
+    }
+
+    if(objects.empty())
+        return;
+
+    hittableList flatList;
+    for(const std::shared_ptr<hittable>& object : objects){
+        flatList.add(object);
+    }
+
+    std::vector<bvhPrimitive> buildPrimitives = bvhPrimitives(flatList, tStart, tEnd, std::max(1, settings.threadCount));
+    std::vector<uint32_t> primitiveIndices;
+    nodes = bvhNode::buildNodes(buildPrimitives, primitiveIndices, settings);
+
+    //group every leaf by type, then lay the typed arrays out in leaf order so a run of spheres in a leaf is contiguous in memory
+    for(const linearBvhNode& node : nodes){
+        if(node.primitiveCount > 0){
+            std::stable_sort(primitiveIndices.begin() + node.offset, primitiveIndices.begin() + node.offset + node.primitiveCount,
+                             [&](uint32_t a, uint32_t b){ return types[a] < types[b]; });
+        }
+    }
+
+    std::unordered_map<const material*, uint32_t> materialLookup;
+    references.reserve(primitiveIndices.size());
+
+    for(uint32_t primitiveIndex : primitiveIndices){
+        const hittable& object = *objects[primitiveIndex];
+
+        switch(types[primitiveIndex]){
+            case compiledPrimitiveType::sphere:
+                references.push_back(makeReference(compiledPrimitiveType::sphere, static_cast<uint32_t>(spheres.materialIndex.size())));
+                appendSphere(static_cast<const sphere&>(object), materialLookup);
+                break;
+            case compiledPrimitiveType::rectangle:
+                references.push_back(makeReference(compiledPrimitiveType::rectangle, static_cast<uint32_t>(rectangles.materialIndex.size())));
+                appendRectangle(object, materialLookup);
+                break;
+            default:
+                references.push_back(makeReference(compiledPrimitiveType::generic, static_cast<uint32_t>(generics.size())));
+                generics.push_back(&object);
+                break;
+        }
+    }
+
+    for(std::vector<float>* channel : { &spheres.centerX, &spheres.centerY, &spheres.centerZ, &spheres.velocityX, &spheres.velocityY, &spheres.velocityZ, &spheres.radius }){
+        channel->resize(channel->size() + 3, 0.0f);
+    }
+}
+
+//boxes and nested lists are opened up so their rectangles end up in the typed arrays as well
+void compiledScene::flatten(const std::shared_ptr<hittable>& object, std::vector<compiledPrimitiveType>& types){
+    const hittable* raw = object.get();
+
+    if(const hittableList* list = dynamic_cast<const hittableList*>(raw)){
+        for(const std::shared_ptr<hittable>& child : list->objectList()){
+            flatten(child, types);
+        }
+        return;
+    }
+
+    if(const box* boxObject = dynamic_cast<const box*>(raw)){
+        for(const std::shared_ptr<hittable>& side : boxObject->sides.objectList()){
+            flatten(side, types);
+        }
+        return;
+    }
+
+    if(dynamic_cast<const sphere*>(raw))
+        types.push_back(compiledPrimitiveType::sphere);
+    else if(dynamic_cast<const rectangleXY*>(raw) || dynamic_cast<const rectangleXZ*>(raw) || dynamic_cast<const rectangleYZ*>(raw))
+        types.push_back(compiledPrimitiveType::rectangle);
+    else
+        types.push_back(compiledPrimitiveType::generic);
+
+    objects.push_back(object);
+}
+
+uint32_t compiledScene::materialIndex(const std::shared_ptr<material>& surfaceMaterial, std::unordered_map<const material*, uint32_t>& materialLookup){
+    auto found = materialLookup.find(surfaceMaterial.get());
+    if(found != materialLookup.end())
+        return found->second;
+
+    uint32_t index = static_cast<uint32_t>(materials.size());
+    materials.push_back(surfaceMaterial);
+    materialLookup[surfaceMaterial.get()] = index;
+    return index;
+}
+
+void compiledScene::appendSphere(const sphere& object, std::unordered_map<const material*, uint32_t>& materialLookup){
+    glm::vec3 velocity = (object.endCenter - object.startCenter) / (object.endTime - object.startTime);
+    glm::vec3 centerAtZero = object.startCenter - object.startTime * velocity;
+
+    spheres.centerX.push_back(centerAtZero.x);
+    spheres.centerY.push_back(centerAtZero.y);
+    spheres.centerZ.push_back(centerAtZero.z);
+    spheres.velocityX.push_back(velocity.x);
+    spheres.velocityY.push_back(velocity.y);
+    spheres.velocityZ.push_back(velocity.z);
+    spheres.radius.push_back(object.radius);
+    spheres.materialIndex.push_back(materialIndex(object.materialPointer, materialLookup));
+    spheres.objectId.push_back(object.objectId);
+}
+
+void compiledScene::appendRectangle(const hittable& object, std::unordered_map<const material*, uint32_t>& materialLookup){
+    auto append = [&](int constAxis, int axisA, int axisB, float constValue, float minA, float maxA, float minB, float maxB,
+                      float tStart, float tEnd, const glm::vec3& displacement, const std::shared_ptr<material>& surfaceMaterial){
+        rectangles.constAxis.push_back(static_cast<uint8_t>(constAxis));
+        rectangles.axisA.push_back(static_cast<uint8_t>(axisA));
+        rectangles.axisB.push_back(static_cast<uint8_t>(axisB));
+        rectangles.constValue.push_back(constValue);
+        rectangles.minA.push_back(minA);
+        rectangles.maxA.push_back(maxA);
+        rectangles.minB.push_back(minB);
+        rectangles.maxB.push_back(maxB);
+        rectangles.startTime.push_back(tStart);
+        rectangles.inverseDuration.push_back(1.0f / (tEnd - tStart));
+        rectangles.displacement.push_back(displacement);
+        rectangles.materialIndex.push_back(materialIndex(surfaceMaterial, materialLookup));
+        rectangles.objectId.push_back(object.objectId);
+    };
+
+    if(const rectangleXY* xy = dynamic_cast<const rectangleXY*>(&object))
+        append(2, 0, 1, xy->constZ, xy->leftX, xy->rightX, xy->bottomY, xy->topY, xy->tStart, xy->tEnd, xy->displacement, xy->mat);
+    else if(const rectangleXZ* xz = dynamic_cast<const rectangleXZ*>(&object))
+        append(1, 0, 2, xz->constY, xz->leftX, xz->rightX, xz->frontZ, xz->backZ, xz->tStart, xz->tEnd, xz->displacement, xz->mat);
+    else if(const rectangleYZ* yz = dynamic_cast<const rectangleYZ*>(&object))
+        append(0, 1, 2, yz->constX, yz->bottomY, yz->topY, yz->frontZ, yz->backZ, yz->tStart, yz->tEnd, yz->displacement, yz->mat);
+}
+
+//same quadratic as sphere::hit over a contiguous run of spheres, four at a time
+inline bool compiledScene::hitSpheres(uint32_t first, uint32_t count, const ray& r, float distMin, float distMax, float& hitDistance, uint32_t& hitIndex) const {
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 direction = r.direction();
+    const float time = r.hitTime();
+    const float a = lengthSquared(direction);
+    bool hitAnything = false;
+
+#ifdef COMPILED_SCENE_SSE
+    //a single sphere is cheaper to test on its own
+    if(count > 1){
+        const __m128 timeWide = _mm_set1_ps(time);
+        const __m128 aWide = _mm_set1_ps(a);
+        const __m128 distMinWide = _mm_set1_ps(distMin);
+        const __m128 zero = _mm_setzero_ps();
+
+        for(uint32_t group = 0; group < count; group += 4){
+            const uint32_t i = first + group;
+            const int validMask = count - group >= 4 ? 0xF : (1 << (count - group)) - 1;
+
+            __m128 ocX = _mm_sub_ps(_mm_set1_ps(origin.x), _mm_add_ps(_mm_loadu_ps(&spheres.centerX[i]), _mm_mul_ps(_mm_loadu_ps(&spheres.velocityX[i]), timeWide)));
+            __m128 ocY = _mm_sub_ps(_mm_set1_ps(origin.y), _mm_add_ps(_mm_loadu_ps(&spheres.centerY[i]), _mm_mul_ps(_mm_loadu_ps(&spheres.velocityY[i]), timeWide)));
+            __m128 ocZ = _mm_sub_ps(_mm_set1_ps(origin.z), _mm_add_ps(_mm_loadu_ps(&spheres.centerZ[i]), _mm_mul_ps(_mm_loadu_ps(&spheres.velocityZ[i]), timeWide)));
+            __m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+
+            __m128 bHalf = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(direction.x), ocX), _mm_mul_ps(_mm_set1_ps(direction.y), ocY)), _mm_mul_ps(_mm_set1_ps(direction.z), ocZ));
+            __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_mul_ps(radius, radius));
+            __m128 discriminant = _mm_sub_ps(_mm_mul_ps(bHalf, bHalf), _mm_mul_ps(aWide, c));
+            __m128 sqrtDiscriminant = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+
+            __m128 distMaxWide = _mm_set1_ps(distMax);
+            __m128 nearDistance = _mm_div_ps(_mm_sub_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), aWide);
+            __m128 farDistance = _mm_div_ps(_mm_add_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), aWide);
+            __m128 nearValid = _mm_and_ps(_mm_cmpge_ps(nearDistance, distMinWide), _mm_cmple_ps(nearDistance, distMaxWide));
+            __m128 farValid = _mm_and_ps(_mm_cmpge_ps(farDistance, distMinWide), _mm_cmple_ps(farDistance, distMaxWide));
+
+            __m128 distance = _mm_or_ps(_mm_and_ps(nearValid, nearDistance), _mm_andnot_ps(nearValid, farDistance));
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(discriminant, zero), _mm_or_ps(nearValid, farValid));
+            int hitMask = _mm_movemask_ps(hit) & validMask;
+            if(!hitMask)
+                continue;
+
+            alignas(16) float distances[4];
+            _mm_store_ps(distances, distance);
+            for(int lane = 0; lane < 4; lane++){
+                if((hitMask & (1 << lane)) && distances[lane] <= distMax){
+                    distMax = distances[lane];
+                    hitDistance = distances[lane];
+                    hitIndex = i + lane;
+                    hitAnything = true;
+                }
+            }
+        }
+
+        return hitAnything;
+    }
+#endif
+
+    for(uint32_t i = first; i < first + count; i++){
+        glm::vec3 center(spheres.centerX[i] + spheres.velocityX[i] * time, spheres.centerY[i] + spheres.velocityY[i] * time, spheres.centerZ[i] + spheres.velocityZ[i] * time);
+        glm::vec3 originMinCenter = origin - center;
+        float bHalf = dot(direction, originMinCenter);
+        float c = lengthSquared(originMinCenter) - spheres.radius[i] * spheres.radius[i];
+        float discriminant = bHalf*bHalf - a*c;
+
+        if(discriminant < 0.0)
+            continue;
+
+        float sqrtDiscriminant = std::sqrt(discriminant);
+        float distance = (-bHalf - sqrtDiscriminant) / a;
+        if(distance < distMin || distance > distMax){
+            distance = (-bHalf + sqrtDiscriminant) / a;
+            if(distance < distMin || distance > distMax)
+                continue;
+        }
+
+        distMax = distance;
+        hitDistance = distance;
+        hitIndex = i;
+        hitAnything = true;
+    }
+
+    return hitAnything;
+}
+
+inline bool compiledScene::hitRectangle(uint32_t index, const ray& r, float distMin, float distMax, float& hitDistance) const {
+    const int constAxis = rectangles.constAxis[index];
+    const int axisA = rectangles.axisA[index];
+    const int axisB = rectangles.axisB[index];
+    const glm::vec3 delta = std::min(1.0f, (r.hitTime() - rectangles.startTime[index]) * rectangles.inverseDuration[index]) * rectangles.displacement[index];
+    const point3 origin = r.origin();
+    const glm::vec3 rayDirection = r.direction();
+
+    float distance = (rectangles.constValue[index] + delta[constAxis] - origin[constAxis]) / rayDirection[constAxis];
+    if(distance < distMin || distance > distMax)
+        return false;
+
+    float rayA = origin[axisA] + rayDirection[axisA] * distance;
+    float rayB = origin[axisB] + rayDirection[axisB] * distance;
+    if(rayA < rectangles.minA[index] + delta[axisA] || rayA > rectangles.maxA[index] + delta[axisA] ||
+       rayB < rectangles.minB[index] + delta[axisB] || rayB > rectangles.maxB[index] + delta[axisB])
+        return false;
+
+    hitDistance = distance;
+    return true;
+}
+
+//normal, uv and material are only worked out once, for the closest typed hit
+void compiledScene::finalize(const ray& r, const hitQuery& query, hitRecord& record) const {
+    const uint32_t reference = query.primitiveId;
+    const uint32_t index = reference & indexMask;
+    record.distance = query.distance;
+    record.hitLocation = r.at(query.distance);
+
+    if(referenceType(reference) == compiledPrimitiveType::sphere){
+        const float time = r.hitTime();
+        glm::vec3 center(spheres.centerX[index] + spheres.velocityX[index] * time, spheres.centerY[index] + spheres.velocityY[index] * time, spheres.centerZ[index] + spheres.velocityZ[index] * time);
+        glm::vec3 outwardNormal = (record.hitLocation - center) / spheres.radius[index];
+        record.setFaceNormal(r, outwardNormal);
+        record.materialPointer = materials[spheres.materialIndex[index]];
+        record.objectId = spheres.objectId[index];
+        record.u = (atan2(-outwardNormal.z, outwardNormal.x) + pi) / (2 * pi);
+        record.v = acos(-outwardNormal.y) / pi;
+    }
+    else{
+        const int axisA = rectangles.axisA[index];
+        const int axisB = rectangles.axisB[index];
+        glm::vec3 outwardNormal(0,0,0);
+        outwardNormal[rectangles.constAxis[index]] = 1.0f;
+        record.setFaceNormal(r, outwardNormal);
+        record.materialPointer = materials[rectangles.materialIndex[index]];
+        record.objectId = rectangles.objectId[index];
+        record.u = (record.hitLocation[axisA] - rectangles.minA[index]) / (rectangles.maxA[index] - rectangles.minA[index]);
+        record.v = (record.hitLocation[axisB] - rectangles.minB[index]) / (rectangles.maxB[index] - rectangles.minB[index]);
+    }
+}
+
+bool compiledScene::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
+    if(nodes.empty())
+        return false;
+
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+    const bool directionNegative[3] = { inverseDirection.x < 0.0f, inverseDirection.y < 0.0f, inverseDirection.z < 0.0f };
+
+    uint32_t nodeStack[maxTraversalDepth];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    const uint32_t noHit = ~0u;
+    uint32_t closestReference = noHit;
+
+    #ifdef BVH_STATS
+    bvhStats.rays++;
+    #endif
+
+    while(true){
+        const linearBvhNode& node = nodes[nodeIndex];
+
+        #ifdef BVH_STATS
+        bvhStats.nodeFetches++;
+        #endif
+
+        if(hitNodeBox(node, origin, inverseDirection, distMin, distMax)){
+            if(node.primitiveCount > 0){
+                uint32_t i = node.offset;
+                const uint32_t leafEnd = node.offset + node.primitiveCount;
+
+                while(i < leafEnd){
+                    const uint32_t reference = references[i];
+                    const uint32_t index = reference & indexMask;
+                    float hitDistance;
+
+                    switch(referenceType(reference)){
+                        case compiledPrimitiveType::sphere: {
+                            //leaves are grouped by type and the sphere arrays follow leaf order, so the run is contiguous
+                            uint32_t runEnd = i + 1;
+                            while(runEnd < leafEnd && referenceType(references[runEnd]) == compiledPrimitiveType::sphere) runEnd++;
+
+                            uint32_t hitIndex;
+                            if(hitSpheres(index, runEnd - i, r, distMin, distMax, hitDistance, hitIndex)){
+                                distMax = hitDistance;
+                                closestReference = makeReference(compiledPrimitiveType::sphere, hitIndex);
+                            }
+                            i = runEnd;
+                            break;
+                        }
+                        case compiledPrimitiveType::rectangle:
+                            if(hitRectangle(index, r, distMin, distMax, hitDistance)){
+                                distMax = hitDistance;
+                                closestReference = reference;
+                            }
+                            i++;
+                            break;
+                        default:
+                            if(generics[index]->intersect(r, distMin, distMax, query)){
+                                distMax = query.distance;
+                                closestReference = reference;
+                            }
+                            i++;
+                            break;
+                    }
+                }
+
+                if(stackSize == 0)
+                    break;
+                nodeIndex = nodeStack[--stackSize];
+            }
+            else if(directionNegative[node.axis]){
+                nodeStack[stackSize++] = nodeIndex + 1;
+                nodeIndex = node.offset;
+            }
+            else{
+                nodeStack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+            }
+        }
+        else{
+            if(stackSize == 0)
+                break;
+            nodeIndex = nodeStack[--stackSize];
+        }
+    }
+
+    if(closestReference == noHit)
+        return false;
+
+    //generic hits already filled in the query
+    if(referenceType(closestReference) != compiledPrimitiveType::generic)
+        query.claim(this, distMax, closestReference);
+
+    return true;
+}
+
+//same walk as intersect with a fixed interval, the first sphere run, rectangle or generic primitive that is hit ends it
+bool compiledScene::occluded(const ray& r, float distMin, float distMax) const {
+    if(nodes.empty())
+        return false;
+
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 inverseDirection = 1.0f / r.direction();
+
+    uint32_t nodeStack[maxTraversalDepth];
+    int stackSize = 0;
+    uint32_t nodeIndex = 0;
+
+    #ifdef BVH_STATS
+    bvhStats.rays++;
+    #endif
+
+    while(true){
+        const linearBvhNode& node = nodes[nodeIndex];
+
+        #ifdef BVH_STATS
+        bvhStats.nodeFetches++;
+        #endif
+
+        if(hitNodeBox(node, origin, inverseDirection, distMin, distMax)){
+            if(node.primitiveCount > 0){
+                uint32_t i = node.offset;
+                const uint32_t leafEnd = node.offset + node.primitiveCount;
+
+                while(i < leafEnd){
+                    const uint32_t reference = references[i];
+                    const uint32_t index = reference & indexMask;
+                    float hitDistance;
+
+                    switch(referenceType(reference)){
+                        case compiledPrimitiveType::sphere: {
+                            uint32_t runEnd = i + 1;
+                            while(runEnd < leafEnd && referenceType(references[runEnd]) == compiledPrimitiveType::sphere) runEnd++;
+
+                            uint32_t hitIndex;
+                            if(hitSpheres(index, runEnd - i, r, distMin, distMax, hitDistance, hitIndex))
+                                return true;
+                            i = runEnd;
+                            break;
+                        }
+                        case compiledPrimitiveType::rectangle:
+                            if(hitRectangle(index, r, distMin, distMax, hitDistance))
+                                return true;
+                            i++;
+                            break;
+                        default:
+                            if(generics[index]->occluded(r, distMin, distMax))
+                                return true;
+                            i++;
+                            break;
+                    }
+                }
+            }
+            else{
+                nodeStack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+        }
+
+        if(stackSize == 0)
+            return false;
+        nodeIndex = nodeStack[--stackSize];
+    }
+}
+
+bool compiledScene::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
+    if(nodes.empty())
+        return false;
+
+    refbox = axisAlignedBoundingBox(point3(nodes[0].boundsMin[0], nodes[0].boundsMin[1], nodes[0].boundsMin[2]),
+                                    point3(nodes[0].boundsMax[0], nodes[0].boundsMax[1], nodes[0].boundsMax[2]));
+    return true;
+}
+
+#endif //COMPILED_SCENE_HPP
@@ -0,0 +1,79 @@
+#ifndef DENOISE_HPP
+#define DENOISE_HPP
+
+#include <iostream>
+#include <vector>
+#include "../vendor/OIDN/oidn.hpp"
+
+//Intel Open Image Denoise on linear HDR images, the device is created once and reused for the final image and every snapshot
+class denoiser{
+private:
+    oidn::DeviceRef device;
+    bool verbose;
+
+    void status(const char* message) const {
+        if(verbose)
+            std::cerr << '\r' << message << "                                       " << std::flush;
+    }
+
+public:
+    denoiser(bool verbose = true):
+        verbose{verbose}
+        {
+            // Create an Intel Open Image Denoise device
+            status("creating devices");
+            device = oidn::newDevice();
+            device.commit();
+        }
+
+    //denoises inputHDR into outputHDR, albedoHDR and normalHDR (normals in [-1, 1]) are prefiltered in place first
+    bool denoise(std::vector<float>& inputHDR, std::vector<float>& albedoHDR, std::vector<float>& normalHDR, std::vector<float>& outputHDR, int image_width, int image_height){
+        outputHDR.resize(inputHDR.size());
+
+        // Create a filter for denoising a beauty (color) image using prefiltered auxiliary images too
+        status("setting beautyfilter");
+        oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
+        filter.setImage("color",  &inputHDR[0],  oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // beauty
+        filter.setImage("albedo", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // auxiliary
+        filter.setImage("normal", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // auxiliary
+        filter.setImage("output", &outputHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // denoised beauty
+        filter.set("hdr", true); // beauty image is HDR
+        filter.set("cleanAux", false); // auxiliary images will be prefiltered
+        filter.commit();
+
+        // Create a separate filter for denoising an auxiliary albedo image (in-place)
+        status("setting prefilter albedo");
+        oidn::FilterRef albedoFilter = device.newFilter("RT"); // same filter type as for beauty
+        albedoFilter.setImage("albedo", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
+        albedoFilter.setImage("output", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
+        albedoFilter.commit();
+
+        // Create a separate filter for denoising an auxiliary normal image (in-place)
+        status("setting prefilter normal");
+        oidn::FilterRef normalFilter = device.newFilter("RT"); // same filter type as for beauty
+        normalFilter.setImage("normal", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
+        normalFilter.setImage("output", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
+        normalFilter.commit();
+
+        // Prefilter the auxiliary images
+        status("prefiltering albedo");
+        albedoFilter.execute();
+        status("prefiltering normals");
+        normalFilter.execute();
+
+        // Filter the beauty image
+        status("denoising beauty image");
+        filter.execute();
+        status("denoised beauty image");
+
+        // Check for errors
+        const char* errorMessage;
+        if(device.getError(errorMessage) != oidn::Error::None){
+            std::cerr << "\nError: " << errorMessage << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+#endif //DENOISE_HPP
@@ -0,0 +1,107 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <vector>
+#include <iostream>
+#include "rtweekend.hpp"
+#include "imageWriting.hpp"
+
+//linear float accumulation buffer shared by all render threads: rgb sums of the radiance samples and the sample count in alpha,
+//rows run from the top of the image down, tiles never overlap so threads write disjoint pixels without locking.
+//The summed squared sample luminances next to it give every pixel's variance for adaptive sampling
+class framebuffer{
+private:
+    int width;
+    int height;
+    std::vector<float> pixels;
+    std::vector<float> luminanceSquares;
+
+public:
+    static const int channels = 4;
+
+    framebuffer(int width = 0, int height = 0):
+        width{width},
+        height{height},
+        pixels(static_cast<size_t>(width) * height * channels, 0.0f),
+        luminanceSquares(static_cast<size_t>(width) * height, 0.0f)
+        {}
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    void addSamples(int x, int row, const color& colorSum, int sampleCount, float luminanceSquareSum = 0.0f){
+        float* pixel = &pixels[(static_cast<size_t>(row) * width + x) * channels];
+        pixel[0] += colorSum.r;
+        pixel[1] += colorSum.g;
+        pixel[2] += colorSum.b;
+        pixel[3] += static_cast<float>(sampleCount);
+        luminanceSquares[static_cast<size_t>(row) * width + x] += luminanceSquareSum;
+    }
+
+    int sampleCount(int x, int row) const {
+        return static_cast<int>(pixels[(static_cast<size_t>(row) * width + x) * channels + 3]);
+    }
+
+    //mean radiance of the pixel, black while it has no samples
+    color getPixel(int x, int row) const {
+        const float* pixel = &pixels[(static_cast<size_t>(row) * width + x) * channels];
+        if(pixel[3] <= 0.0f)
+            return color(0,0,0);
+        return color(pixel[0], pixel[1], pixel[2]) / pixel[3];
+    }
+
+    //standard error of the pixel's mean luminance as it shows up after the gamma 2 tone mapping, in units of the display range,
+    //the derivative of sqrt scales it by 1 / (2 sqrt(mean)) so noise in dark pixels counts more than the same noise in bright ones
+    float displayError(int x, int row) const {
+        const size_t index = static_cast<size_t>(row) * width + x;
+        const float sampleCount = pixels[index * channels + 3];
+        if(sampleCount < 2.0f)
+            return infinity;
+
+        const float mean = luminance(color(pixels[index * channels + 0], pixels[index * channels + 1], pixels[index * channels + 2])) / sampleCount;
+        const float variance = std::max(0.0f, (luminanceSquares[index] - sampleCount * mean * mean) / (sampleCount - 1.0f));
+        if(variance == 0.0f)
+            return 0.0f;
+
+        return std::sqrt(variance / sampleCount) / (2.0f * std::sqrt(std::max(mean, 1e-6f)));
+    }
+
+    void clear(){
+        std::fill(pixels.begin(), pixels.end(), 0.0f);
+        std::fill(luminanceSquares.begin(), luminanceSquares.end(), 0.0f);
+    }
+
+    //raw accumulation state for checkpoints, the size is fixed by the dimensions so only the floats are stored
+    void serialize(std::ostream& out) const {
+        out.write(reinterpret_cast<const char*>(pixels.data()), pixels.size() * sizeof(float));
+        out.write(reinterpret_cast<const char*>(luminanceSquares.data()), luminanceSquares.size() * sizeof(float));
+    }
+
+    bool deserialize(std::istream& in){
+        in.read(reinterpret_cast<char*>(pixels.data()), pixels.size() * sizeof(float));
+        in.read(reinterpret_cast<char*>(luminanceSquares.data()), luminanceSquares.size() * sizeof(float));
+        return static_cast<bool>(in);
+    }
+
+    //linear rgb means, unclamped, the input oidn expects with hdr enabled
+    void writeHDR(std::vector<float>& hdrBuffer) const {
+        hdrBuffer.resize(static_cast<size_t>(width) * height * 3);
+        for(int row = 0; row < height; row++){
+            for(int x = 0; x < width; x++){
+                color pixelColor = getPixel(x, row);
+                size_t index = (static_cast<size_t>(row) * width + x) * 3;
+                hdrBuffer[index + 0] = pixelColor.r;
+                hdrBuffer[index + 1] = pixelColor.g;
+                hdrBuffer[index + 2] = pixelColor.b;
+            }
+        }
+    }
+
+    void writeSDR(std::vector<uint8_t>& sdrBuffer) const {
+        std::vector<float> hdrBuffer;
+        writeHDR(hdrBuffer);
+        toneMap(hdrBuffer, sdrBuffer);
+    }
+};
+
+#endif //FRAMEBUFFER_HPP
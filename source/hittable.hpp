@@ -1,10 +1,14 @@
 #ifndef HITTABLE_HPP
 #define HITTABLE_HPP
 
+#include <atomic>
 #include "ray.hpp"
+#include "rayPacket.hpp"
 #include "axisAlignedBoundingBox.hpp"
+#include "lightBounds.hpp"
 
 class material; //tells compiler material class will be declared somewhere later on
+class hittable;
 
 struct hitRecord{
     point3 hitLocation;
@@ -16,6 +20,7 @@ struct hitRecord{
     float v;
     
     std::shared_ptr<material> materialPointer;
+    uint32_t objectId = 0;
 
     inline void setFaceNormal(const ray& r, const glm::vec3& outwardNormal){
         frontFace = glm::dot(r.direction(), outwardNormal) < 0.0;
@@ -23,10 +28,91 @@ struct hitRecord{
     }
 };
 
+//lightweight result of hittable::intersect, only the distance and who has to fill in the surface details later on
+struct hitQuery{
+    static const int maxInstanceDepth = 8;
+
+    float distance;
+    const hittable* object;                         //primitive that was hit
+    uint32_t primitiveId;                           //meaning is up to the primitive, e.g. the member of a sphereGroup
+    const hittable* instances[maxInstanceDepth];    //transforms the hit was found through, innermost first
+    int instanceDepth = 0;
+
+    void claim(const hittable* primitive, float hitDistance, uint32_t id = 0){
+        distance = hitDistance;
+        object = primitive;
+        primitiveId = id;
+        instanceDepth = 0;
+    }
+
+    //the outermost transform finalizes first and chains inwards down to the primitive
+    const hittable* finalizer() const { return instanceDepth > 0 ? instances[instanceDepth - 1] : object; }
+};
+
+//ids handed out in construction order, so the same scene gets the same ids in every run, 0 means no object
+inline uint32_t newObjectId(){
+    static std::atomic<uint32_t> nextObjectId{1};
+    return nextObjectId++;
+}
+
 class hittable{
 public:
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const = 0;
+    //written to the object id aov by the primitives that fill in hit records
+    uint32_t objectId = newObjectId();
+
+    //closest hit as distance and primitive only, aggregates pass the children's query through and transforms add themselves
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const = 0;
+
+    //fills in normal, uv and material for a hit this object claimed or was an instance in, runs once per ray
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const {}
+
+    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const;
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const = 0;
+
+    //whether anything lies between distMin and distMax, for visibility tests that don't need the hit itself.
+    //Aggregates stop at the first hit they find instead of searching for the closest one
+    virtual bool occluded(const ray& r, float distMin, float distMax) const {
+        hitQuery query;
+        return intersect(r, distMin, distMax, query);
+    }
+
+    //light sampling, primitives with an emissive material that can pick directions towards themselves
+    virtual bool emitsLight() const { return false; }
+
+    //solid angle density of sampleDirection choosing direction from origin, 0 where the direction misses the object
+    virtual float pdfValue(const point3& origin, const glm::vec3& direction, float time) const { return 0.0f; }
+
+    //unnormalized direction from origin towards a point on the object chosen with a 2D sample
+    virtual glm::vec3 sampleDirection(const point3& origin, const glm::vec2& sample, float time) const { return glm::vec3(1,0,0); }
+
+    //position, power and emission directions over the shutter interval for the light tree
+    virtual bool getLightBounds(float tStart, float tEnd, lightBounds& bounds) const { return false; }
+
+    //intersects the lanes in activeMask, shrinking distMax per lane, and returns the lanes that found a closer hit
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const {
+        int hitMask = 0;
+        for(int lane = 0; lane < rayPacket::width; lane++){
+            if((activeMask & (1 << lane)) && hit(packet.rays[lane], distMin, distMax[lane], records[lane])){
+                distMax[lane] = records[lane].distance;
+                hitMask |= 1 << lane;
+            }
+        }
+
+        return hitMask;
+    }
 };
 
+inline void finalizeHit(const ray& r, const hitQuery& query, hitRecord& record){
+    query.finalizer()->finalize(r, query, record);
+}
+
+inline bool hittable::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
+    hitQuery query;
+    if(!intersect(r, distMin, distMax, query))
+        return false;
+
+    finalizeHit(r, query, record);
+    return true;
+}
+
 #endif //HITTABLE_HPP
\ No newline at end of file
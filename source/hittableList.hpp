@@ -14,30 +14,50 @@ public:
     void clear() { objects.clear(); }
     void add(std::shared_ptr<hittable> object) { objects.push_back(object); }
 
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override;
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override;
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override;
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override;
 
-    std::vector<std::shared_ptr<hittable>> objectList() const {
+    const std::vector<std::shared_ptr<hittable>>& objectList() const {
         return objects;
     }
 };
 
-bool hittableList::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
-    hitRecord tempRecord;
+//children only write the query when they find a closer hit, so it can be passed straight through
+bool hittableList::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
     bool hit = false;
     float closestHitDist = distMax;
 
     for(const auto& object : objects){
-        if(object->hit(r, distMin, closestHitDist, tempRecord)){
+        if(object->intersect(r, distMin, closestHitDist, query)){
             hit = true;
-            closestHitDist = tempRecord.distance;
-            record = tempRecord;
+            closestHitDist = query.distance;
         }
     }
     
     return hit;
 }
 
+bool hittableList::occluded(const ray& r, float distMin, float distMax) const {
+    for(const auto& object : objects){
+        if(object->occluded(r, distMin, distMax))
+            return true;
+    }
+
+    return false;
+}
+
+int hittableList::hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const {
+    int hitMask = 0;
+
+    for(const auto& object : objects){
+        hitMask |= object->hitPacket(packet, activeMask, distMin, distMax, records);
+    }
+
+    return hitMask;
+}
+
 bool hittableList::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
     if(objects.empty())
         return false;
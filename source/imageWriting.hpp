@@ -89,4 +89,13 @@ inline void convertHDRtoSDR(const std::vector<float>& hdrBuffer, std::vector<uin
     }
 }
 
+//linear radiance to displayable bytes with gamma 2 and clipping like writeColor, the only place the image gets quantized
+inline void toneMap(const std::vector<float>& hdrBuffer, std::vector<uint8_t>& sdrBuffer){
+    sdrBuffer.resize(hdrBuffer.size());
+    for(size_t i = 0; i < hdrBuffer.size(); i++){
+        float gammaCorrected = std::sqrt(std::max(0.0f, hdrBuffer[i]));
+        sdrBuffer[i] = static_cast<uint8_t>(256 * clamp(gammaCorrected, 0.0f, 0.999f));
+    }
+}
+
 #endif //IMAGE_WRITING_HPP
\ No newline at end of file
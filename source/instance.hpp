@@ -3,6 +3,7 @@
 
 #include <limits>
 #include "hittable.hpp"
+#include "hittableList.hpp"
 #include "glm/gtx/transform.hpp"
 
 class translate : public hittable{
@@ -23,15 +24,29 @@ public:
         object{object}
         {}
     
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override {
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
         ray rayTranslated(r.origin() - translation, r.direction(), r.hitTime());
-        if(!object->hit(rayTranslated, distMin, distMax, record))
+        hitQuery innerQuery;
+        if(!object->intersect(rayTranslated, distMin, distMax, innerQuery) || innerQuery.instanceDepth == hitQuery::maxInstanceDepth)
             return false;
 
+        query = innerQuery;
+        query.instances[query.instanceDepth++] = this;
+        return true;
+    }
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        return object->occluded(ray(r.origin() - translation, r.direction(), r.hitTime()), distMin, distMax);
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override {
+        ray rayTranslated(r.origin() - translation, r.direction(), r.hitTime());
+        hitQuery innerQuery = query;
+        innerQuery.instanceDepth--;
+        finalizeHit(rayTranslated, innerQuery, record);
+
         record.hitLocation += translation;
         record.setFaceNormal(rayTranslated, record.normal);
-
-        return true;
     }
 
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
@@ -41,80 +56,35 @@ public:
         refbox.translate(translation);
         return true;
     }
+
+    const std::shared_ptr<hittable>& inner() const { return object; }
+    glm::mat4 transform() const { return glm::translate(translation); }
 };
 
 class rotate : public hittable{
 private:
     std::shared_ptr<hittable> object;
-    glm::vec3 rotation;
-    float sinTheta[3];
-    float cosTheta[3];
     bool hasBoundingBox;
     axisAlignedBoundingBox rotatedBoundingBox;
-
-    inline glm::vec3 rotationX(const glm::vec3& position, float sign = 1.0) const {
-        float signedSinTheta = sign * sinTheta[0];
-        glm::vec3 positionRotated;
-
-        positionRotated.x = position.x;
-        positionRotated.y = cosTheta[0] * position.y - signedSinTheta * position.z;
-        positionRotated.z = signedSinTheta * position.y + cosTheta[0] * position.z;
-        
-        return positionRotated;
-    }
-
-    inline glm::vec3 rotationY(const glm::vec3& position, float sign = 1.0) const {
-        float signedSinTheta = sign * sinTheta[1];
-        glm::vec3 positionRotated;
-
-        positionRotated.x =  cosTheta[1] * position.x + signedSinTheta * position.z;
-        positionRotated.y =  position.y;
-        positionRotated.z = -signedSinTheta * position.x + cosTheta[1] * position.z;
-        
-        return positionRotated;
-    }
-
-    inline glm::vec3 rotationZ(const glm::vec3& position, float sign = 1.0) const {
-        float signedSinTheta = sign * sinTheta[2];
-        glm::vec3 positionRotated;
-
-        positionRotated.x = cosTheta[2] * position.x - signedSinTheta * position.y;
-        positionRotated.y = signedSinTheta * position.x + cosTheta[2] * position.y;
-        positionRotated.z = position.z;
-        
-        return positionRotated;
-    }
+    glm::mat3 rotationMatrix;           //built once, not per ray
+    glm::mat3 reverseRotationMatrix;    //the transpose, rotations are orthonormal
 
     inline glm::vec3 applyRotation(const glm::vec3& position) const {
-        // return rotationX(rotationY(rotationZ(position)));
-        return glm::vec3(glm::rotate(rotation.z, point3(0,0,1)) * glm::rotate(rotation.y, point3(0,1,0)) * glm::rotate(rotation.x, point3(1,0,0)) * glm::vec4(position,0));
+        return rotationMatrix * position;
     }
 
     inline glm::vec3 applyReverseRotation(const glm::vec3& position) const {
-        // return rotationX(rotationY(rotationZ(position, -1.0f) -1.0f), -1.0f);
-        return glm::vec3(glm::rotate(-rotation.z, point3(0,0,1)) * glm::rotate(-rotation.y, point3(0,1,0)) * glm::rotate(-rotation.x, point3(1,0,0)) * glm::vec4(position,0));
+        return reverseRotationMatrix * position;
     }
 
 public:
+    //rotations in degrees, applied around x first, then y, then z
     rotate(glm::vec3 rotations, const std::shared_ptr<hittable>& objectPtr){
         object = objectPtr;
-        rotation = rotations;
-
-        for(int i = 0; i < 3; i++){
-            rotation[i] = glm::radians(rotations[i]);
-        }
-
-        float thetaX = degrees_to_radians(rotation.x);
-        float thetaY = degrees_to_radians(rotation.y);
-        float thetaZ = degrees_to_radians(rotation.z);
-
-        sinTheta[0] = sin(thetaX);
-        sinTheta[1] = sin(thetaY);
-        sinTheta[2] = sin(thetaZ);
 
-        cosTheta[0] = cos(thetaX);
-        cosTheta[1] = cos(thetaY);
-        cosTheta[2] = cos(thetaZ);
+        const glm::vec3 radians = glm::radians(rotations);
+        rotationMatrix = glm::mat3(glm::rotate(radians.z, point3(0,0,1)) * glm::rotate(radians.y, point3(0,1,0)) * glm::rotate(radians.x, point3(1,0,0)));
+        reverseRotationMatrix = glm::transpose(rotationMatrix);
 
         hasBoundingBox = object->boundingBox(0, 1, rotatedBoundingBox);
 
@@ -142,25 +112,160 @@ public:
         rotatedBoundingBox = axisAlignedBoundingBox(min, max);
     }
 
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override {
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
         point3 originRotated = applyReverseRotation(r.origin());
         glm::vec3 directionRotated = applyReverseRotation(r.direction());
 
         ray rayRotated(originRotated, directionRotated, r.hitTime());
-        if(!object->hit(rayRotated, distMin, distMax, record))
+        hitQuery innerQuery;
+        if(!object->intersect(rayRotated, distMin, distMax, innerQuery) || innerQuery.instanceDepth == hitQuery::maxInstanceDepth)
             return false;
 
+        query = innerQuery;
+        query.instances[query.instanceDepth++] = this;
+        return true;
+    }
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        return object->occluded(ray(applyReverseRotation(r.origin()), applyReverseRotation(r.direction()), r.hitTime()), distMin, distMax);
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override {
+        point3 originRotated = applyReverseRotation(r.origin());
+        glm::vec3 directionRotated = applyReverseRotation(r.direction());
+
+        ray rayRotated(originRotated, directionRotated, r.hitTime());
+        hitQuery innerQuery = query;
+        innerQuery.instanceDepth--;
+        finalizeHit(rayRotated, innerQuery, record);
+
         record.hitLocation = applyRotation(record.hitLocation);
         record.setFaceNormal(rayRotated, applyRotation(record.normal));
+    }
 
+    virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
+        refbox = rotatedBoundingBox;
+        return hasBoundingBox;
+    }
+
+    const std::shared_ptr<hittable>& inner() const { return object; }
+    glm::mat4 transform() const { return glm::mat4(rotationMatrix); }
+};
+
+//one affine transform in place of a chain of translate and rotate wrappers (or any other matrix, e.g. with scaling): the ray is
+//moved into object space with a single matrix multiply and only the final hit is moved back. The direction is not normalized,
+//so hit distances are the same in both spaces
+class instance : public hittable{
+private:
+    std::shared_ptr<hittable> object;
+    glm::mat4 objectToWorld;
+    glm::mat4 worldToObject;
+    glm::mat3 normalToWorld;    //inverse transpose of the linear part
+    bool hasBoundingBox;
+    axisAlignedBoundingBox worldBoundingBox;
+
+    ray toObject(const ray& r) const {
+        return ray(point3(worldToObject * glm::vec4(r.origin(), 1.0f)), glm::mat3(worldToObject) * r.direction(), r.hitTime());
+    }
+
+public:
+    instance(const std::shared_ptr<hittable>& object, const glm::mat4& objectToWorld):
+        object{object}
+        {
+            setTransform(objectToWorld);
+        }
+
+    //moves the instance, whatever accelerates the objects around it has to be rebuilt afterwards
+    void setTransform(const glm::mat4& transform){
+        objectToWorld = transform;
+        worldToObject = glm::inverse(transform);
+        normalToWorld = glm::transpose(glm::mat3(worldToObject));
+
+        axisAlignedBoundingBox objectBox;
+        hasBoundingBox = object->boundingBox(0, 1, objectBox);
+        if(!hasBoundingBox)
+            return;
+
+        const point3 corners[2] = { glm::min(objectBox.cornerClosest(), objectBox.cornerFarthest()), glm::max(objectBox.cornerClosest(), objectBox.cornerFarthest()) };
+        point3 min(std::numeric_limits<float>::infinity());
+        point3 max(-std::numeric_limits<float>::infinity());
+        for(int corner = 0; corner < 8; corner++){
+            point3 position = point3(objectToWorld * glm::vec4(corners[corner & 1].x, corners[(corner >> 1) & 1].y, corners[corner >> 2].z, 1.0f));
+            min = glm::min(min, position);
+            max = glm::max(max, position);
+        }
+        worldBoundingBox = axisAlignedBoundingBox(min, max);
+    }
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
+        hitQuery innerQuery;
+        if(!object->intersect(toObject(r), distMin, distMax, innerQuery) || innerQuery.instanceDepth == hitQuery::maxInstanceDepth)
+            return false;
+
+        query = innerQuery;
+        query.instances[query.instanceDepth++] = this;
         return true;
     }
 
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        return object->occluded(toObject(r), distMin, distMax);
+    }
+
+    //the inner record's normal already faces the object space ray, the transform keeps that side so frontFace stays valid
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override {
+        hitQuery innerQuery = query;
+        innerQuery.instanceDepth--;
+        finalizeHit(toObject(r), innerQuery, record);
+
+        record.hitLocation = point3(objectToWorld * glm::vec4(record.hitLocation, 1.0f));
+        record.normal = glm::normalize(normalToWorld * record.normal);
+    }
+
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
-        refbox = rotatedBoundingBox;
+        refbox = worldBoundingBox;
         return hasBoundingBox;
     }
 
+    const std::shared_ptr<hittable>& inner() const { return object; }
+    glm::mat4 transform() const { return objectToWorld; }
 };
 
+//collapses a chain of translate, rotate and instance wrappers into one instance with the product of their transforms,
+//other objects are returned as they are
+inline std::shared_ptr<hittable> bakeTransforms(const std::shared_ptr<hittable>& object){
+    glm::mat4 transform(1.0f);
+    std::shared_ptr<hittable> inner = object;
+    int chainLength = 0;
+
+    while(true){
+        if(const translate* translation = dynamic_cast<const translate*>(inner.get())){
+            transform = transform * translation->transform();
+            inner = translation->inner();
+        }
+        else if(const rotate* rotation = dynamic_cast<const rotate*>(inner.get())){
+            transform = transform * rotation->transform();
+            inner = rotation->inner();
+        }
+        else if(const instance* baked = dynamic_cast<const instance*>(inner.get())){
+            transform = transform * baked->transform();
+            inner = baked->inner();
+        }
+        else{
+            break;
+        }
+        chainLength++;
+    }
+
+    return chainLength > 0 ? std::make_shared<instance>(inner, transform) : object;
+}
+
+//bakes the transform chains among the top level objects of list
+inline hittableList bakeTransforms(const hittableList& list){
+    hittableList baked;
+    for(const std::shared_ptr<hittable>& object : list.objectList()){
+        baked.add(bakeTransforms(object));
+    }
+    return baked;
+}
+
 #endif //INSTANCE_HPP
\ No newline at end of file
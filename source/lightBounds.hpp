@@ -0,0 +1,147 @@
+#ifndef LIGHT_BOUNDS_HPP
+#define LIGHT_BOUNDS_HPP
+
+#include <cmath>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "axisAlignedBoundingBox.hpp"
+
+//cos(max(0, a - b)) and sin(max(0, a - b)) from the sines and cosines of both angles
+inline float cosSubtractClamped(float sinA, float cosA, float sinB, float cosB){
+    return cosA > cosB ? 1.0f : cosA * cosB + sinA * sinB;
+}
+
+inline float sinSubtractClamped(float sinA, float cosA, float sinB, float cosB){
+    return cosA > cosB ? 0.0f : sinA * cosB - cosA * sinB;
+}
+
+inline float safeSqrt(float value){
+    return std::sqrt(std::max(0.0f, value));
+}
+
+//what a group of emitters can contribute: where they are, how much they emit and in which directions. Emission leaves along
+//directions within thetaO of axis (the normals) and spreads up to thetaE further (the emission profile, pi/2 for diffuse emitters).
+//Two sided emitters also emit around -axis. power is 0 for empty bounds
+struct lightBounds{
+    axisAlignedBoundingBox box;
+    glm::vec3 axis = glm::vec3(0,0,1);
+    float power = 0.0f;
+    float cosThetaO = 1.0f;
+    float cosThetaE = 1.0f;
+    bool twoSided = false;
+
+    lightBounds(){}
+
+    lightBounds(const axisAlignedBoundingBox& bounds, const glm::vec3& axis, float power, float cosThetaO, float cosThetaE, bool twoSided):
+        box(glm::min(bounds.cornerClosest(), bounds.cornerFarthest()), glm::max(bounds.cornerClosest(), bounds.cornerFarthest())),
+        axis{axis},
+        power{power},
+        cosThetaO{cosThetaO},
+        cosThetaE{cosThetaE},
+        twoSided{twoSided}
+        {}
+
+    bool empty() const { return power <= 0.0f; }
+
+    //conservative estimate of the light arriving at point on a surface with normal, 0 only if none can arrive.
+    //A zero normal leaves the surface orientation out
+    float importance(const point3& point, const glm::vec3& normal) const {
+        const point3 boundsMin = glm::min(box.cornerClosest(), box.cornerFarthest());
+        const point3 boundsMax = glm::max(box.cornerClosest(), box.cornerFarthest());
+        const point3 center = box.centroid();
+        const float radiusSquared = 0.25f * lengthSquared(box.extent());
+
+        //points close to or inside the bounds would get an arbitrarily large estimate
+        const glm::vec3 fromCenter = point - center;
+        const float centerDistanceSquared = lengthSquared(fromCenter);
+        const float distanceSquared = std::max(centerDistanceSquared, radiusSquared);
+        const glm::vec3 toPoint = centerDistanceSquared > 0.0f ? fromCenter / std::sqrt(centerDistanceSquared) : axis;
+
+        float cosThetaW = glm::dot(axis, toPoint);
+        if(twoSided)
+            cosThetaW = std::fabs(cosThetaW);
+        const float sinThetaW = safeSqrt(1.0f - cosThetaW * cosThetaW);
+
+        //half angle the bounds cover as seen from point
+        const bool inside = glm::all(glm::greaterThanEqual(point, boundsMin)) && glm::all(glm::lessThanEqual(point, boundsMax));
+        const float cosThetaB = (inside || centerDistanceSquared <= radiusSquared) ? -1.0f : safeSqrt(1.0f - radiusSquared / centerDistanceSquared);
+        const float sinThetaB = safeSqrt(1.0f - cosThetaB * cosThetaB);
+
+        //smallest angle between the direction to point and any emission direction of any point in the bounds
+        const float sinThetaO = safeSqrt(1.0f - cosThetaO * cosThetaO);
+        const float cosThetaX = cosSubtractClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+        const float sinThetaX = sinSubtractClamped(sinThetaW, cosThetaW, sinThetaO, cosThetaO);
+        const float cosThetaP = cosSubtractClamped(sinThetaX, cosThetaX, sinThetaB, cosThetaB);
+        if(cosThetaP <= cosThetaE)
+            return 0.0f;
+
+        float estimate = power * cosThetaP / distanceSquared;
+
+        if(normal != glm::vec3(0,0,0)){
+            const float cosThetaI = std::fabs(glm::dot(toPoint, normal));
+            const float sinThetaI = safeSqrt(1.0f - cosThetaI * cosThetaI);
+            estimate *= cosSubtractClamped(sinThetaI, cosThetaI, sinThetaB, cosThetaB);
+        }
+
+        return std::max(estimate, 0.0f);
+    }
+
+    //solid angle measure of the emission directions, weighted by the cosine falloff, for the orientation cost of the tree build
+    float orientationMeasure() const {
+        const float thetaO = std::acos(glm::clamp(cosThetaO, -1.0f, 1.0f));
+        const float thetaE = std::acos(glm::clamp(cosThetaE, -1.0f, 1.0f));
+        const float thetaW = std::min(thetaO + thetaE, static_cast<float>(pi));
+        const float sinThetaO = safeSqrt(1.0f - cosThetaO * cosThetaO);
+        return static_cast<float>(2.0 * pi) * (1.0f - cosThetaO) +
+               static_cast<float>(pi / 2.0) * (2.0f * thetaW * sinThetaO - std::cos(thetaO - 2.0f * thetaW) - 2.0f * thetaO * sinThetaO + cosThetaO);
+    }
+};
+
+//smallest cone around both cones given by axis and cosine of the half angle
+inline void surroundingCone(const glm::vec3& axisA, float cosThetaA, const glm::vec3& axisB, float cosThetaB, glm::vec3& axis, float& cosTheta){
+    const float thetaA = std::acos(glm::clamp(cosThetaA, -1.0f, 1.0f));
+    const float thetaB = std::acos(glm::clamp(cosThetaB, -1.0f, 1.0f));
+    const float thetaD = std::acos(glm::clamp(glm::dot(axisA, axisB), -1.0f, 1.0f));
+
+    if(std::min(thetaD + thetaB, static_cast<float>(pi)) <= thetaA){
+        axis = axisA;
+        cosTheta = cosThetaA;
+        return;
+    }
+    if(std::min(thetaD + thetaA, static_cast<float>(pi)) <= thetaB){
+        axis = axisB;
+        cosTheta = cosThetaB;
+        return;
+    }
+
+    const float thetaO = 0.5f * (thetaA + thetaD + thetaB);
+    const glm::vec3 rotationAxis = glm::cross(axisA, axisB);
+    if(thetaO >= pi || lengthSquared(rotationAxis) <= 0.0f){
+        axis = axisA;
+        cosTheta = -1.0f;
+        return;
+    }
+
+    //rotates axisA towards axisB until the cone reaches around both
+    const float thetaR = thetaO - thetaA;
+    const glm::vec3 k = glm::normalize(rotationAxis);
+    axis = glm::normalize(axisA * std::cos(thetaR) + glm::cross(k, axisA) * std::sin(thetaR) + k * glm::dot(k, axisA) * (1.0f - std::cos(thetaR)));
+    cosTheta = std::cos(thetaO);
+}
+
+inline lightBounds surroundingLightBounds(const lightBounds& a, const lightBounds& b){
+    if(a.empty())
+        return b;
+    if(b.empty())
+        return a;
+
+    lightBounds bounds;
+    bounds.box = surroundingBox(a.box, b.box);
+    bounds.power = a.power + b.power;
+    surroundingCone(a.axis, a.cosThetaO, b.axis, b.cosThetaO, bounds.axis, bounds.cosThetaO);
+    bounds.cosThetaE = std::min(a.cosThetaE, b.cosThetaE);
+    bounds.twoSided = a.twoSided || b.twoSided;
+    return bounds;
+}
+
+#endif //LIGHT_BOUNDS_HPP
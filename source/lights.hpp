@@ -0,0 +1,311 @@
+#ifndef LIGHTS_HPP
+#define LIGHTS_HPP
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "lightBounds.hpp"
+#include "material.hpp"
+#include "sampler.hpp"
+
+//node of the light tree, the left child of an interior node directly follows it in the node array
+struct lightTreeNode{
+    lightBounds bounds;
+    uint32_t offset;    //leaf: index of the light, interior: index of the right child
+    bool leaf;
+};
+
+//emissive primitives of the scene for next event estimation. Lights are looked up by object id, which survives compiling the
+//scene and building the bvh, so a bsdf sampled ray that hits a light can ask how likely light sampling was to pick that direction.
+//A light is chosen by walking a tree over the lights' bounds, at every node the child with the larger estimated contribution
+//at the shading point is more likely, so picking one of n lights costs O(log n) importance evaluations
+class lightList{
+private:
+    static const int binCount = 12;
+    static const int maxSplitDepth = 32;    //deeper nodes are halved in list order, so every path from the root fits the 64 bits of branches
+
+    std::vector<std::shared_ptr<hittable>> lights;
+    std::vector<lightBounds> bounds;
+    std::vector<uint64_t> branches;         //per light, bit i set where its path turns right at depth i
+    std::unordered_map<uint32_t, uint32_t> lightIndex;
+    std::vector<lightTreeNode> nodes;
+    float tStart;
+    float tEnd;
+
+    void collect(const hittableList& objects){
+        for(const std::shared_ptr<hittable>& object : objects.objectList()){
+            if(const hittableList* nested = dynamic_cast<const hittableList*>(object.get()))
+                collect(*nested);
+            else if(object->emitsLight())
+                add(object);
+        }
+    }
+
+    //cost of a node in the tree build: power times the surface area of its box and the spread of its emission directions,
+    //boxes that are thin along the split axis are not rewarded for it
+    static float splitCost(const lightBounds& node, float parentMaxExtent, float parentAxisExtent){
+        if(node.empty())
+            return 0.0f;
+
+        float thinness = parentAxisExtent > 0.0f ? parentMaxExtent / parentAxisExtent : 1.0f;
+        return node.power * node.orientationMeasure() * node.box.surfaceArea() * thinness;
+    }
+
+    //lights [first, last) of order, binned by centroid along every axis like the bvh, returns the index of the node it created
+    uint32_t buildNode(std::vector<uint32_t>& order, size_t first, size_t last, int depth, uint64_t branch){
+        const uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(lightTreeNode());
+
+        if(last - first == 1){
+            const uint32_t light = order[first];
+            nodes[nodeIndex] = { bounds[light], light, true };
+            branches[light] = branch;
+            return nodeIndex;
+        }
+
+        lightBounds nodeBounds;
+        point3 centroidMin(infinity), centroidMax(-infinity);
+        for(size_t i = first; i < last; i++){
+            nodeBounds = surroundingLightBounds(nodeBounds, bounds[order[i]]);
+            centroidMin = glm::min(centroidMin, bounds[order[i]].box.centroid());
+            centroidMax = glm::max(centroidMax, bounds[order[i]].box.centroid());
+        }
+
+        const glm::vec3 extent = nodeBounds.box.extent();
+        const float maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+        const glm::vec3 centroidExtent = centroidMax - centroidMin;
+
+        float bestCost = infinity;
+        int bestAxis = -1;
+        int bestBin = 0;
+        for(int axis = 0; axis < 3 && depth < maxSplitDepth; axis++){
+            if(centroidExtent[axis] <= 0.0f)
+                continue;
+
+            lightBounds bins[binCount];
+            for(size_t i = first; i < last; i++){
+                lightBounds& bin = bins[binIndex(bounds[order[i]], axis, centroidMin, centroidExtent)];
+                bin = surroundingLightBounds(bin, bounds[order[i]]);
+            }
+
+            //sweep from the left storing the cost of everything below each plane, then from the right adding the other half
+            float costs[binCount - 1];
+            lightBounds sweep;
+            for(int i = 0; i < binCount - 1; i++){
+                sweep = surroundingLightBounds(sweep, bins[i]);
+                costs[i] = splitCost(sweep, maxExtent, extent[axis]);
+            }
+
+            sweep = lightBounds();
+            for(int i = binCount - 1; i > 0; i--){
+                sweep = surroundingLightBounds(sweep, bins[i]);
+                costs[i - 1] += splitCost(sweep, maxExtent, extent[axis]);
+            }
+
+            for(int split = 0; split < binCount - 1; split++){
+                float cost = costs[split];
+                if(cost < bestCost){
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = split;
+                }
+            }
+        }
+
+        size_t middle = first;
+        if(bestAxis >= 0){
+            middle = std::partition(order.begin() + first, order.begin() + last, [&](uint32_t light){
+                return binIndex(bounds[light], bestAxis, centroidMin, centroidExtent) <= bestBin;
+            }) - order.begin();
+        }
+        //lights that share one centroid, or a split that left a side empty, are halved in list order
+        if(middle == first || middle == last)
+            middle = first + (last - first) / 2;
+
+        nodes[nodeIndex].bounds = nodeBounds;
+        nodes[nodeIndex].leaf = false;
+        buildNode(order, first, middle, depth + 1, branch);
+        nodes[nodeIndex].offset = buildNode(order, middle, last, depth + 1, branch | (uint64_t(1) << depth));
+        return nodeIndex;
+    }
+
+    static int binIndex(const lightBounds& light, int axis, const point3& centroidMin, const glm::vec3& centroidExtent){
+        int bin = static_cast<int>(binCount * (light.box.centroid()[axis] - centroidMin[axis]) / centroidExtent[axis]);
+        return std::min(std::max(bin, 0), binCount - 1);
+    }
+
+    //probabilities of both children of an interior node, false when neither can contribute
+    bool childProbability(const lightTreeNode& node, uint32_t nodeIndex, const point3& origin, const glm::vec3& normal, float& leftProbability) const {
+        float leftImportance = nodes[nodeIndex + 1].bounds.importance(origin, normal);
+        float rightImportance = nodes[node.offset].bounds.importance(origin, normal);
+        if(leftImportance + rightImportance <= 0.0f)
+            return false;
+
+        leftProbability = leftImportance / (leftImportance + rightImportance);
+        return true;
+    }
+
+public:
+    lightList(){}
+
+    //the emitters of the world before it is accelerated, lights inside instances are not sampled and are only found by bsdf rays.
+    //Their bounds cover the shutter interval [tStart, tEnd]
+    lightList(const hittableList& world, float tStart = 0.0f, float tEnd = 1.0f):
+        tStart{tStart},
+        tEnd{tEnd}
+        {
+            collect(world);
+            build();
+        }
+
+    //lights that emit nothing are left out, only bsdf rays find them
+    void add(const std::shared_ptr<hittable>& light){
+        lightBounds lightBox;
+        if(!light->getLightBounds(tStart, tEnd, lightBox))
+            return;
+
+        lightIndex[light->objectId] = static_cast<uint32_t>(lights.size());
+        lights.push_back(light);
+        bounds.push_back(lightBox);
+    }
+
+    //rebuilds the tree over the lights added so far
+    void build(){
+        nodes.clear();
+        branches.assign(lights.size(), 0);
+        if(lights.empty())
+            return;
+
+        std::vector<uint32_t> order(lights.size());
+        for(uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+
+        nodes.reserve(2 * lights.size() - 1);
+        buildNode(order, 0, order.size(), 0, 0);
+    }
+
+    size_t size() const { return lights.size(); }
+    bool empty() const { return lights.empty(); }
+
+    //picks a light by its estimated contribution at origin on a surface with normal, and a direction towards it.
+    //pdf is the solid angle density including the probability of choosing the light
+    bool sample(const point3& origin, const glm::vec3& normal, float time, float lightSample, const glm::vec2& directionSample,
+                glm::vec3& direction, const hittable*& light, float& pdf) const {
+        if(nodes.empty())
+            return false;
+
+        //a single light still has to be able to reach the shading point
+        if(nodes[0].leaf && nodes[0].bounds.importance(origin, normal) <= 0.0f)
+            return false;
+
+        uint32_t nodeIndex = 0;
+        float selectionProbability = 1.0f;
+        while(!nodes[nodeIndex].leaf){
+            const lightTreeNode& node = nodes[nodeIndex];
+            float leftProbability;
+            if(!childProbability(node, nodeIndex, origin, normal, leftProbability))
+                return false;
+
+            //the sample is stretched over the chosen child's range so it stays uniform for the next level
+            if(lightSample < leftProbability){
+                lightSample = std::min(lightSample / leftProbability, 0.99999994f);
+                selectionProbability *= leftProbability;
+                nodeIndex = nodeIndex + 1;
+            }
+            else{
+                lightSample = std::min((lightSample - leftProbability) / (1.0f - leftProbability), 0.99999994f);
+                selectionProbability *= 1.0f - leftProbability;
+                nodeIndex = node.offset;
+            }
+        }
+
+        light = lights[nodes[nodeIndex].offset].get();
+        direction = light->sampleDirection(origin, directionSample, time);
+        pdf = light->pdfValue(origin, direction, time) * selectionProbability;
+        return pdf > 0.0f;
+    }
+
+    //density sample would have produced direction with, 0 for objects that are not in the list
+    float pdf(uint32_t objectId, const point3& origin, const glm::vec3& normal, const glm::vec3& direction, float time) const {
+        auto entry = lightIndex.find(objectId);
+        if(entry == lightIndex.end())
+            return 0.0f;
+
+        if(nodes[0].leaf && nodes[0].bounds.importance(origin, normal) <= 0.0f)
+            return 0.0f;
+
+        //follows the light's path from the root with the same child probabilities sample used
+        const uint64_t branch = branches[entry->second];
+        uint32_t nodeIndex = 0;
+        float selectionProbability = 1.0f;
+        for(int depth = 0; !nodes[nodeIndex].leaf; depth++){
+            const lightTreeNode& node = nodes[nodeIndex];
+            float leftProbability;
+            if(!childProbability(node, nodeIndex, origin, normal, leftProbability))
+                return 0.0f;
+
+            if(branch & (uint64_t(1) << depth)){
+                selectionProbability *= 1.0f - leftProbability;
+                nodeIndex = node.offset;
+            }
+            else{
+                selectionProbability *= leftProbability;
+                nodeIndex = nodeIndex + 1;
+            }
+        }
+
+        return lights[entry->second]->pdfValue(origin, direction, time) * selectionProbability;
+    }
+};
+
+//power heuristic with exponent 2 for combining light and bsdf sampling
+inline float powerHeuristic(float pdf, float otherPdf){
+    float pdfSquared = pdf * pdf;
+    float otherPdfSquared = otherPdf * otherPdf;
+    return pdfSquared + otherPdfSquared > 0.0f ? pdfSquared / (pdfSquared + otherPdfSquared) : 0.0f;
+}
+
+//next event estimation at a surface whose material samplesLights: one shadow ray towards a chosen light, weighted against the
+//chance that scattering would have found the same direction. Always draws three sampler dimensions so the scatter that follows
+//gets the same ones whether a light was found or not
+inline color sampleDirectLight(const ray& rayIncoming, const hitRecord& record, const lightList& lights, const hittable& world, sampler& samples){
+    const float lightSample = samples.get1D();
+    const glm::vec2 directionSample = samples.get2D();
+    const float time = rayIncoming.hitTime();
+
+    glm::vec3 direction;
+    const hittable* light;
+    float lightPdf;
+    if(!lights.sample(record.hitLocation, record.normal, time, lightSample, directionSample, direction, light, lightPdf))
+        return color(0,0,0);
+
+    color bsdf = record.materialPointer->evaluate(rayIncoming, record, direction);
+    if(bsdf == color(0,0,0))
+        return color(0,0,0);
+
+    //the point on the light comes from the light alone, the world only has to be empty up to it
+    const ray shadowRay(record.hitLocation, direction, time);
+    hitRecord lightRecord;
+    if(!light->hit(shadowRay, 0.001, infinity, lightRecord) || world.occluded(shadowRay, 0.001, lightRecord.distance * (1.0f - 1e-4f)))
+        return color(0,0,0);
+
+    color lightEmitted = lightRecord.materialPointer->emitted(lightRecord.u, lightRecord.v, lightRecord.hitLocation);
+    float scatterPdf = record.materialPointer->scatterPdf(rayIncoming, record, direction);
+    return bsdf * lightEmitted * (powerHeuristic(lightPdf, scatterPdf) / lightPdf);
+}
+
+//weight of emission found by a scattered ray leaving a surface with scatterNormal, scatterPdf is 0 after the camera and specular
+//bounces, those count it fully
+inline float emissionWeight(const lightList* lights, const ray& scatteredRay, const glm::vec3& scatterNormal, const hitRecord& record, float scatterPdf){
+    if(!lights || scatterPdf <= 0.0f)
+        return 1.0f;
+
+    float lightPdf = lights->pdf(record.objectId, scatteredRay.origin(), scatterNormal, scatteredRay.direction(), scatteredRay.hitTime());
+    return powerHeuristic(scatterPdf, lightPdf);
+}
+
+#endif //LIGHTS_HPP
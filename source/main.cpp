@@ -13,11 +13,40 @@
 #define OIDN
 
 //Select MultiThreading or Singlethreading
-//Single threaded rendering is borked at this moment!
 #define MT
 
 //enable BVH
-// #define BVH
+#define BVH
+
+//pack neighbouring spheres into groups of 8 that are intersected with one SIMD kernel
+// #define SPHERE_GROUPS
+
+//count bvh node fetches per ray, printed by the benchmark
+// #define BVH_STATS
+
+//trace camera rays of 8 neighbouring pixels as one packet
+#define PRIMARY_PACKETS
+
+//fixed render seed, the image is bit identical for every run and any thread count
+// #define DETERMINISTIC
+
+//stop sampling converged pixels early and give noisy ones up to adaptiveSampling.maxSampleCount samples
+// #define ADAPTIVE_SAMPLING
+
+//diffuse surfaces sample the scene's emitters directly, combined with bsdf sampling by multiple importance sampling
+#define NEXT_EVENT_ESTIMATION
+
+//render the whole image in passes of a few samples until the sample target or time budget, with snapshots in between, replaces adaptive sampling
+// #define PROGRESSIVE
+
+//write the accumulation buffers to checkpointPath between progressive passes and continue from that file when it exists, needs PROGRESSIVE
+// #define CHECKPOINT
+
+//write the depth, object id and material id aovs next to the image
+// #define AOV_OUTPUT
+
+//trace primary rays through every acceleration structure, compare both integrators and the samplers instead of rendering
+// #define BENCHMARK
 
 //enable debug printing
 // #define DEBUG
@@ -40,125 +69,160 @@ using namespace std::chrono_literals;
 #include "camera.hpp"
 #include "workCounter.hpp"
 #include "bvhNode.hpp"
+#include "bvh4.hpp"
 #include "scene.hpp"
+#include "sphereGroup.hpp"
+#include "wavefront.hpp"
+#include "tileScheduler.hpp"
+#include "adaptiveSampling.hpp"
+#include "progressive.hpp"
+#include "checkpoint.hpp"
+#include "benchmark.hpp"
 
 #ifdef OIDN
-    #include "../vendor/OIDN/oidn.hpp"
+    #include "denoise.hpp"
 #endif
 
-color rayNormalColor(const ray& r, const hittable& world, int depth){
-//object color[]
-    hitRecord record;
-
-    if(world.hit(r, 0.001, infinity, record)){
-        return 0.5f * (record.normal + glm::vec3(1,1,1)); //normal vector color
-    }
-    
-    return color(0,0,0);
-}
-
-color rayAlbedoColor(const ray& r, const color& backgroundColor, const hittable& world, int depth){
-    //object color
-    hitRecord record;
-
-    color attenuation;
-    if(world.hit(r, 0.001, infinity, record)){
-        return record.materialPointer->getAlbedoColor(r, record, attenuation);
-    }
+//radiance along a camera ray whose closest hit has already been found, the packet path traces the camera rays itself.
+//The path is followed iteratively with its throughput, after russianRouletteDepth bounces paths with little throughput left
+//are ended at random and the survivors are weighted up, so the result stays unbiased and deep maxDepth values stay cheap.
+//With settings.lights diffuse surfaces also sample a light directly and both estimates are combined with multiple importance sampling
+color rayColorFromHit(const ray& cameraRay, bool hit, const hitRecord& cameraRecord, const renderSettings& settings, const hittable& world, sampler& samples){
+    color radiance(0,0,0);
+    color throughput(1,1,1);
+    ray r = cameraRay;
+    hitRecord record = cameraRecord;
+    float scatterPdf = 0.0f;
+    glm::vec3 scatterNormal(0,0,0);
+    const bool sampleLights = settings.lights && !settings.lights->empty();
+
+    for(int depth = 0; depth < settings.maxDepth; depth++){
+        if(depth > 0)
+            hit = world.hit(r, 0.001, infinity, record);
+
+        if(!hit){
+            radiance += throughput * settings.backgroundColor;
+            break;
+        }
 
-    return backgroundColor;
-}
+        color emitted = record.materialPointer->emitted(record.u, record.v, record.hitLocation);
+        if(emitted != color(0,0,0))
+            radiance += throughput * emitted * emissionWeight(settings.lights, r, scatterNormal, record, scatterPdf);
 
-color rayColor(const ray& r, const color& backgroundColor, const hittable& world, int depth){
-    //return stop recursing at max depth
-    if(depth <= 0){
-        return color(0,0,0);
-    }
+        //the last segment's scattered ray would not be traced anymore
+        if(depth + 1 == settings.maxDepth)
+            break;
 
-    //object color
-    hitRecord record;
+        ray rayScattered;
+        color attenuation;
+        samples.nextBounce();
+        const bool diffuse = record.materialPointer->samplesLights();
+        if(sampleLights && diffuse)
+            radiance += throughput * sampleDirectLight(r, record, *settings.lights, world, samples);
 
-    if(!world.hit(r, 0.001, infinity, record))
-        return backgroundColor;
+        if(!record.materialPointer->scatter(r, record, attenuation, rayScattered, samples))
+            break;
 
-    ray rayScattered;
-    color attenuation;
-    color emmited = record.materialPointer->emitted(record.u, record.v, record.hitLocation);
+        scatterPdf = diffuse ? record.materialPointer->scatterPdf(r, record, rayScattered.direction()) : 0.0f;
+        scatterNormal = record.normal;
+        throughput *= attenuation;
+        if(depth + 1 >= settings.russianRouletteDepth && !russianRoulette(throughput, samples))
+            break;
 
-    if(!record.materialPointer->scatter(r, record, attenuation, rayScattered))
-        return emmited;
+        r = rayScattered;
+    }
 
-    //TODO: check remove emmited for optimization
-    return emmited + attenuation * rayColor(rayScattered, backgroundColor, world, depth - 1);
+    return radiance;
 }
 
 
-void renderImage(const int image_width, const int image_height, const int pixelSampleCount, std::vector<uint8_t>& imageBuffer, 
-                 const camera& worldCamera, const hittableList& world, workCounter& counter, const color& backgroundColor, const int maxDepth = 10)
-{
-    std::random_device randomDevice;
-    std::mt19937 rng(randomDevice());
-    int index = 0;
+//renders the samples [sampleStart, sampleStart + pixelSampleCount) of every pixel of the tile, the samples only depend on seed, pixel and sample index
+//so the image does not depend on how the tiles are spread over threads or how a pixel's samples are split into passes
+//the aovs come from the camera rays' first hits, no extra rays are traced for them
+void renderImage(const imageTile& tile, const renderSettings& settings, framebuffer& output, aovBuffers* aovs, const camera& worldCamera, const hittableList& world){
+    const int image_width = settings.image_width;
+    const int image_height = settings.image_height;
+    const int pixelSampleCount = settings.pixelSampleCount;
+    const int sampleEnd = settings.sampleStart + pixelSampleCount;
+
+    #ifdef PRIMARY_PACKETS
+    sampler laneSamplers[rayPacket::width];
+    std::fill(laneSamplers, laneSamplers + rayPacket::width, sampler(settings.sampling, settings.seed, settings.samplerSampleCount()));
+    #else
+    sampler samples(settings.sampling, settings.seed, settings.samplerSampleCount());
+    #endif
 
-    for(int y = image_height - 1; y >= 0; y--){
-        counter.incrementWorkMain();
-        for(int x = 0; x < image_width; x++){
-            color pixelColorSum = color(0,0,0);
-            for(int s = 0; s < pixelSampleCount; s++){
-                double u = (x + randomFloat(rng, 0.0, 1.0)) / (image_width - 1);
-                double v = (y + randomFloat(rng, 0.0, 1.0)) / (image_height - 1);
-                pixelColorSum += rayColor(worldCamera.getRay(u,v,rng), backgroundColor, world, maxDepth);
+    for(int row = tile.row0; row < tile.row1; row++){
+        const int y = image_height - 1 - row;
+
+        #ifdef PRIMARY_PACKETS
+        for(int x = tile.x0; x < tile.x1; x += rayPacket::width){
+            const int packetLanes = std::min(rayPacket::width, tile.x1 - x);
+            color pixelColorSums[rayPacket::width];
+            float luminanceSquareSums[rayPacket::width];
+            aovSample pixelAovs[rayPacket::width];
+            std::fill(pixelColorSums, pixelColorSums + rayPacket::width, color(0,0,0));
+            std::fill(luminanceSquareSums, luminanceSquareSums + rayPacket::width, 0.0f);
+
+            for(int s = settings.sampleStart; s < sampleEnd; s++){
+                rayPacket packet;
+                for(int lane = 0; lane < packetLanes; lane++){
+                    sampler& samples = laneSamplers[lane];
+                    samples.startPixelSample(x + lane, y, s);
+
+                    glm::vec2 pixelOffset = samples.get2D();
+                    double u = (x + lane + pixelOffset.x) / (image_width - 1);
+                    double v = (y + pixelOffset.y) / (image_height - 1);
+                    packet.setRay(lane, worldCamera.getRay(u,v,samples));
+                }
+                packet.finalize();
+
+                float distMax[rayPacket::width];
+                hitRecord records[rayPacket::width];
+                std::fill(distMax, distMax + rayPacket::width, infinity);
+                int hitMask = world.hitPacket(packet, packet.laneMask, 0.001, distMax, records);
+
+                for(int lane = 0; lane < packetLanes; lane++){
+                    if(aovs)
+                        pixelAovs[lane].add(packet.rays[lane], hitMask & (1 << lane), records[lane], settings.backgroundColor);
+                    color sampleColor = rayColorFromHit(packet.rays[lane], hitMask & (1 << lane), records[lane], settings, world, laneSamplers[lane]);
+                    pixelColorSums[lane] += sampleColor;
+                    luminanceSquareSums[lane] += luminance(sampleColor) * luminance(sampleColor);
+                }
             }
 
-            writeColor(std::cout, imageBuffer, index, pixelColorSum, pixelSampleCount);
-            index += 3;
-        }
-    }
-}
-
-void renderAlbedo(const int image_width, const int image_height, const int pixelSampleCount, std::vector<uint8_t>& imageBuffer, 
-                 const camera& worldCamera, const hittableList& world, workCounter& counter, const color& backgroundColor, const int maxDepth = 10)
-{
-    std::random_device randomDevice;
-    std::mt19937 rng(randomDevice());
-    int index = 0;
-
-    for(int y = image_height - 1; y >= 0; y--){
-        counter.incrementWorkAlbedo();
-        for(int x = 0; x < image_width; x++){
-            color pixelColorSum = color(0,0,0);
-            for(int s = 0; s < pixelSampleCount; s++){
-                double u = (x + randomFloat(rng, 0.0, 1.0)) / (image_width - 1);
-                double v = (y + randomFloat(rng, 0.0, 1.0)) / (image_height - 1);
-                pixelColorSum += rayAlbedoColor(worldCamera.getRay(u,v,rng), backgroundColor, world, maxDepth);
+            for(int lane = 0; lane < packetLanes; lane++){
+                output.addSamples(x + lane, row, pixelColorSums[lane], pixelSampleCount, luminanceSquareSums[lane]);
+                if(aovs)
+                    aovs->addSamples(x + lane, row, pixelAovs[lane]);
             }
-
-            writeColor(std::cout, imageBuffer, index, pixelColorSum, pixelSampleCount);
-            index += 3;
         }
-    }
-}
-
-void renderNormal(const int image_width, const int image_height, const int pixelSampleCount, std::vector<uint8_t>& imageBuffer, 
-                 const camera& worldCamera, const hittableList& world, workCounter& counter, const int maxDepth = 10)
-{
-    std::random_device randomDevice;
-    std::mt19937 rng(randomDevice());
-    int index = 0;
-
-    for(int y = image_height - 1; y >= 0; y--){
-        counter.incrementWorkNormal();
-        for(int x = 0; x < image_width; x++){
+        #else
+        for(int x = tile.x0; x < tile.x1; x++){
             color pixelColorSum = color(0,0,0);
-            for(int s = 0; s < pixelSampleCount; s++){
-                double u = (x + randomFloat(rng, 0.0, 1.0)) / (image_width - 1);
-                double v = (y + randomFloat(rng, 0.0, 1.0)) / (image_height - 1);
-                pixelColorSum += rayNormalColor(worldCamera.getRay(u,v,rng), world, maxDepth);
+            float luminanceSquareSum = 0.0f;
+            aovSample pixelAov;
+            for(int s = settings.sampleStart; s < sampleEnd; s++){
+                samples.startPixelSample(x, y, s);
+                glm::vec2 pixelOffset = samples.get2D();
+                double u = (x + pixelOffset.x) / (image_width - 1);
+                double v = (y + pixelOffset.y) / (image_height - 1);
+                ray cameraRay = worldCamera.getRay(u,v,samples);
+
+                hitRecord record;
+                bool hit = world.hit(cameraRay, 0.001, infinity, record);
+                if(aovs)
+                    pixelAov.add(cameraRay, hit, record, settings.backgroundColor);
+                color sampleColor = rayColorFromHit(cameraRay, hit, record, settings, world, samples);
+                pixelColorSum += sampleColor;
+                luminanceSquareSum += luminance(sampleColor) * luminance(sampleColor);
             }
 
-            writeColor(std::cout, imageBuffer, index, pixelColorSum, pixelSampleCount);
-            index += 3;
+            output.addSamples(x, row, pixelColorSum, pixelSampleCount, luminanceSquareSum);
+            if(aovs)
+                aovs->addSamples(x, row, pixelAov);
         }
+        #endif
     }
 }
 
@@ -168,33 +232,76 @@ int main(){
     const int image_width = 800;
     const int image_height = static_cast<int>(image_width / image_aspect_ratio);
     const int pixelSampleCount = 200;
-    const int maxDepth = 8;
+    const int maxDepth = 50;
+    const int russianRouletteDepth = 3;
     const int image_channels = 3;
     const int imageBufferSize = image_width * image_height * image_channels;
+    #ifdef MT
+    const int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    #else
+    const int threadCount = 1;
+    #endif
+
+    // Tiles, ordered from the image center outwards
+    const int tileSize = 32;
+    const tileOrder tileOrdering = tileOrder::spiral;
+
+    // Seed, every camera sample draws from a generator keyed by this seed, its pixel and its sample index
+    #ifdef DETERMINISTIC
+    const uint64_t renderSeed = 0x5eed;
+    #else
+    std::random_device randomDevice;
+    const uint64_t renderSeed = (static_cast<uint64_t>(randomDevice()) << 32) | randomDevice();
+    #endif
+
+    // Sampler, low discrepancy samplers reach a given noise level with fewer samples per pixel
+    const samplerType pixelSampler = samplerType::sobol;
+
+    // Adaptive sampling, pixels stop once their tone mapped noise is below the threshold or they reach the cap
+    adaptiveSettings adaptiveSampling;
+    adaptiveSampling.minSampleCount = 16;
+    adaptiveSampling.maxSampleCount = 4 * pixelSampleCount;
+    adaptiveSampling.samplesPerRound = 16;
+    adaptiveSampling.errorThreshold = 0.005f;
+
+    // Progressive rendering, a usable snapshot within seconds and a final image whose quality scales with the time it gets
+    progressiveSettings progressive;
+    progressive.samplesPerPass = 4;
+    progressive.targetSampleCount = pixelSampleCount;
+    progressive.timeBudget = 0.0;
+    progressive.snapshotInterval = 5.0;
+    progressive.denoiseSnapshots = true;
+    progressive.checkpointInterval = 60.0;
+    const std::string checkpointPath = "./../output/render.checkpoint";
+
+    // Integrator, wavefront processes large batches of paths one bounce at a time instead of one path at a time
+    const renderMode integrator = renderMode::recursive;
+
+    // BVH
+    #ifdef BVH
+    const accelerationStructure worldAcceleration = accelerationStructure::bvh2;
+    #endif
+    bvhSettings bvhBuildSettings;
+    bvhBuildSettings.splitMethod = bvhSplitMethod::sah;
+    bvhBuildSettings.binCount = 12;
+    bvhBuildSettings.maxLeafSize = 4;
+    bvhBuildSettings.threadCount = threadCount;
+
+    #ifdef BENCHMARK
+        benchmarkAccelerationStructures({scene::cornellBox, scene::randomBalls, scene::instanceGrid}, bvhBuildSettings);
+        benchmarkRenderModes({scene::cornellBox, scene::randomBalls}, bvhBuildSettings, renderImage);
+        benchmarkSamplers({scene::cornellBox}, bvhBuildSettings, renderImage);
+        return 0;
+    #endif
     
 #pragma region buffersetup
-    std::vector<uint8_t> inputSDR, albedoSDR, normalSDR, outputSDR;
-    std::vector<float> inputHDR, outputHDR, albedoHDR, normalHDR;
-
-    inputSDR.reserve(imageBufferSize);
-    inputHDR.reserve(imageBufferSize);
-    albedoSDR.reserve(imageBufferSize);
-    albedoHDR.reserve(imageBufferSize);
-    normalSDR.reserve(imageBufferSize);
-    normalHDR.reserve(imageBufferSize);
-    outputHDR.reserve(imageBufferSize);
-
-    for(int i = 0; i < imageBufferSize; i++){
-        inputHDR.push_back(0.0);
-        inputSDR.push_back(0);
-    }
-    outputSDR = inputSDR;
-    albedoSDR = inputSDR;
-    normalSDR = inputSDR;
-    outputHDR = inputHDR;
+    //float images handed to oidn and the 8 bit images written to disk, the renderers accumulate into framebuffers
+    std::vector<uint8_t> inputSDR(imageBufferSize, 0), albedoSDR(imageBufferSize, 0), normalSDR(imageBufferSize, 0), outputSDR(imageBufferSize, 0);
+    std::vector<float> inputHDR(imageBufferSize, 0.0f), outputHDR(imageBufferSize, 0.0f), albedoHDR(imageBufferSize, 0.0f), normalHDR(imageBufferSize, 0.0f);
 #pragma endregion
 
     //Scene
+    const scene renderedScene = scene::cornellBox;
     hittableList world;
     point3 cameraPosition, cameraTarget, cameraUp;
     color backgroundColor(0,0,0);
@@ -204,161 +311,173 @@ int main(){
     auto aperture = 0.1;
     float vFov = 20;
     
-    setScene(scene::cornellBox, world, cameraPosition, cameraTarget, cameraUp, vFov, backgroundColor);
+    setScene(renderedScene, world, cameraPosition, cameraTarget, cameraUp, vFov, backgroundColor);
     camera worldCamera(cameraPosition, cameraTarget, cameraUp, vFov, image_aspect_ratio, aperture, focusDistance, 0.0, 1.0);
 
+    //translate and rotate chains become single instances with one precomputed matrix
+    world = bakeTransforms(world);
 
-    #ifdef BVH
-    world = hittableList(std::make_shared<bvhNode>(world, 0.0, 1.0));
+    //collected before grouping and the bvh, the emitters keep their object ids through both
+    #ifdef NEXT_EVENT_ESTIMATION
+    lightList sceneLights(world);
+    std::cerr << "Lights: " << sceneLights.size() << "\n" << std::flush;
     #endif
 
-    
-    #if defined OIDN && !defined MT
-        workCounter counter(image_height, 1);
-        std::thread albedoThread(renderAlbedo, image_width, image_height, pixelSampleCount, std::ref(albedoSDR), std::ref(worldCamera), std::ref(world), std::ref(counter), 10);
-        std::thread normalThread(renderNormal, image_width, image_height, pixelSampleCount, std::ref(normalSDR), std::ref(worldCamera), std::ref(world), std::ref(counter), 10);
+    #ifdef SPHERE_GROUPS
+    world = groupSpheres(world);
     #endif
-    
-    #ifndef MT
-        renderImage(image_width, image_height, pixelSampleCount, inputSDR, worldCamera, world, maxDepth);
-    #endif
-
-    #ifdef MT
-        const int threadCount = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
-        const int samplesPerThread = std::max(1, pixelSampleCount / threadCount);
 
-        std::vector<std::vector<uint8_t>> mainBuffers;
-        std::vector<std::vector<uint8_t>> albedoBuffers;
-        std::vector<std::vector<uint8_t>> normalBuffers;
+    #ifdef BVH
+    auto bvhBuildStart = std::chrono::steady_clock::now();
+    world = hittableList(buildAccelerationStructure(world, worldAcceleration, bvhBuildSettings, 0.0, 1.0));
+    std::chrono::duration<double, std::milli> bvhBuildTime = std::chrono::steady_clock::now() - bvhBuildStart;
+    std::cerr << accelerationStructureName(worldAcceleration) << " build: " << bvhBuildTime.count() << " ms on " << threadCount << " threads\n" << std::flush;
+    #endif
 
-        std::vector<std::thread> threadPoolMain;
-        std::vector<std::thread> threadPoolAlbedo;
-        std::vector<std::thread> threadPoolNormal;
+    auto renderStart = std::chrono::steady_clock::now();
+
+    renderSettings settings;
+    settings.image_width = image_width;
+    settings.image_height = image_height;
+    settings.pixelSampleCount = pixelSampleCount;
+    settings.maxDepth = maxDepth;
+    settings.russianRouletteDepth = russianRouletteDepth;
+    settings.backgroundColor = backgroundColor;
+    settings.seed = renderSeed;
+    settings.sampling = pixelSampler;
+    #ifdef NEXT_EVENT_ESTIMATION
+    settings.lights = &sceneLights;
+    #endif
 
-        threadPoolMain.reserve(threadCount);
-        threadPoolAlbedo.reserve(threadCount);
-        threadPoolNormal.reserve(threadCount);
+    renderFunction renderer = (integrator == renderMode::wavefront) ? renderImageWavefront : renderImage;
 
-        workCounter counter(image_height, threadCount);
+    //every tile is rendered with all its samples straight into the shared framebuffers, idle threads steal tiles from busy ones,
+    //the denoiser's albedo and normal images are taken from the first hits of the beauty pass
+    framebuffer beautyBuffer(image_width, image_height);
+    #if defined(OIDN) || defined(AOV_OUTPUT)
+    aovBuffers aovs(image_width, image_height);
+    aovBuffers* aovOutput = &aovs;
+    #else
+    aovBuffers* aovOutput = nullptr;
+    #endif
 
-        for(int i = 0; i < threadCount; i++){
-            mainBuffers.push_back(inputSDR);
-        }
-        albedoBuffers = mainBuffers;
-        normalBuffers = mainBuffers;
+    #ifdef OIDN
+    denoiser imageDenoiser;
+    #endif
 
-        for(int i = 0; i < threadCount; i++){
-            threadPoolMain.push_back(std::thread(renderImage, image_width, image_height, samplesPerThread, 
-                                                 std::ref(mainBuffers[i]), std::ref(worldCamera), std::ref(world), 
-                                                 std::ref(counter), std::ref(backgroundColor), 10));
+    const std::vector<imageTile> tiles = makeTiles(image_width, image_height, tileSize, tileOrdering);
 
-            threadPoolAlbedo.push_back(std::thread(renderAlbedo, image_width, image_height, std::min(40, samplesPerThread), 
-                                                   std::ref(albedoBuffers[i]), std::ref(worldCamera), std::ref(world), 
-                                                   std::ref(counter), std::ref(backgroundColor), 10));
+    #ifdef PROGRESSIVE
+    auto writeSnapshot = [&](int sampleCount){
+        std::vector<float> snapshotHDR;
+        std::vector<uint8_t> snapshotSDR;
+        beautyBuffer.writeHDR(snapshotHDR);
+        toneMap(snapshotHDR, snapshotSDR);
+        stbi_write_png("./../output/snapshot.png", image_width, image_height, image_channels, &snapshotSDR[0], 0);
 
-            threadPoolNormal.push_back(std::thread(renderNormal, image_width, image_height, std::min(40, samplesPerThread), 
-                                                   std::ref(normalBuffers[i]), std::ref(worldCamera), std::ref(world), 
-                                                   std::ref(counter), 10));
+        #ifdef OIDN
+        if(progressive.denoiseSnapshots){
+            std::vector<float> snapshotAlbedo, snapshotNormal, snapshotFiltered;
+            aovs.albedo.writeHDR(snapshotAlbedo);
+            aovs.normal.writeHDR(snapshotNormal);
+            if(imageDenoiser.denoise(snapshotHDR, snapshotAlbedo, snapshotNormal, snapshotFiltered, image_width, image_height)){
+                toneMap(snapshotFiltered, snapshotSDR);
+                stbi_write_png("./../output/snapshotFiltered.png", image_width, image_height, image_channels, &snapshotSDR[0], 0);
+            }
         }
+        #endif
+    };
+
+    #ifdef CHECKPOINT
+    //a resumed render takes over the checkpoint's seed and sampler so its samples continue the same sequences
+    checkpointHeader checkpointState;
+    checkpointState.image_width = image_width;
+    checkpointState.image_height = image_height;
+    checkpointState.scene = static_cast<uint32_t>(renderedScene);
+    checkpointState.integrator = static_cast<uint32_t>(integrator);
+    checkpointState.maxDepth = maxDepth;
+    checkpointState.russianRouletteDepth = russianRouletteDepth;
+    checkpointState.targetSampleCount = progressive.targetSampleCount;
+    int resumedSampleCount = 0;
+    if(readCheckpoint(checkpointPath, checkpointState, beautyBuffer, aovOutput)){
+        settings.seed = checkpointState.seed;
+        settings.sampling = static_cast<samplerType>(checkpointState.sampling);
+        resumedSampleCount = checkpointState.sampleCount;
+        std::cerr << "Resuming " << checkpointPath << " at " << resumedSampleCount << " samples per pixel\n" << std::flush;
+    }
 
-        while(!counter.isWorkDone()){
-            counter.outputWorkDone();
-            std::this_thread::sleep_for(500ms);
-        }
+    auto writeRenderCheckpoint = [&](int sampleCount){
+        checkpointState.seed = settings.seed;
+        checkpointState.sampling = static_cast<uint32_t>(settings.sampling);
+        checkpointState.sampleCount = sampleCount;
+        if(!writeCheckpoint(checkpointPath, checkpointState, beautyBuffer, aovOutput))
+            std::cerr << "\nCould not write checkpoint " << checkpointPath << "\n" << std::flush;
+    };
+
+    const int finalSampleCount = renderProgressive(tiles, threadCount, settings, progressive, renderer, beautyBuffer, aovOutput, worldCamera, world, writeSnapshot, writeRenderCheckpoint, resumedSampleCount);
+    if(progressive.targetSampleCount > 0 && finalSampleCount >= progressive.targetSampleCount)
+        removeCheckpoint(checkpointPath);
+    #else
+    renderProgressive(tiles, threadCount, settings, progressive, renderer, beautyBuffer, aovOutput, worldCamera, world, writeSnapshot);
+    #endif
+    #else
+    workCounter counter(static_cast<int>(tiles.size()));
+
+    std::thread renderThread([&](){
+        renderTiles(tiles, threadCount, [&](const imageTile& tile, int worker){
+            #ifdef ADAPTIVE_SAMPLING
+            renderTileAdaptive(tile, settings, adaptiveSampling, renderer, beautyBuffer, aovOutput, worldCamera, world);
+            #else
+            renderer(tile, settings, beautyBuffer, aovOutput, worldCamera, world);
+            #endif
+            counter.incrementWork();
+        });
+    });
+
+    while(!counter.isWorkDone()){
         counter.outputWorkDone();
-        std::cerr << "\n" << std::flush;
-        
-        //clean up threadPool
-        for (int i = 0; i < threadCount; i++){
-            threadPoolMain[i].join();
-            threadPoolAlbedo[i].join();
-            threadPoolNormal[i].join();
-        }
+        std::this_thread::sleep_for(500ms);
+    }
+    counter.outputWorkDone();
+    std::cerr << "\n" << std::flush;
+    renderThread.join();
+    #endif
 
-        std::cerr << '\r' << "merging thread imageBuffers" << std::flush;
-        for(int i = 0; i < imageBufferSize; i++){
-            int sumMain = 0;
-            int sumAlbedo = 0;
-            int sumNormal = 0;
-            for(int j = 0; j < mainBuffers.size(); j++){
-                sumMain += mainBuffers[j][i];
-                sumAlbedo += albedoBuffers[j][i];
-                sumNormal += normalBuffers[j][i];
-            }
-            inputSDR[i] = sumMain / threadCount;
-            albedoSDR[i] = sumAlbedo / threadCount;
-            normalSDR[i] = sumNormal / threadCount;
+    //linear float images straight from the accumulation buffers, they are only tone mapped and quantized for the png output
+    beautyBuffer.writeHDR(inputHDR);
+    #ifdef OIDN
+    aovs.albedo.writeHDR(albedoHDR);
+    aovs.normal.writeHDR(normalHDR);
+    #endif
+
+    std::chrono::duration<double> renderTime = std::chrono::steady_clock::now() - renderStart;
+    std::cerr << "\nRender: " << renderTime.count() << " s\n" << std::flush;
+
+    #if defined(ADAPTIVE_SAMPLING) && !defined(PROGRESSIVE)
+    uint64_t totalSampleCount = 0;
+    for(int row = 0; row < image_height; row++){
+        for(int x = 0; x < image_width; x++){
+            totalSampleCount += beautyBuffer.sampleCount(x, row);
         }
+    }
+    std::cerr << "Adaptive sampling: " << double(totalSampleCount) / (double(image_width) * image_height) << " samples per pixel on average\n" << std::flush;
     #endif
 
     #ifdef OIDN
-        #if defined OIDN && !defined MT
-        std::cerr << '\r' << "waiting for albedo and normal threads                                       " << std::flush;
-        albedoThread.join();
-        normalThread.join();
-        std::cerr << '\r' << "albedo and normal renders done                                       " << std::flush;
-        #endif
+        imageDenoiser.denoise(inputHDR, albedoHDR, normalHDR, outputHDR, image_width, image_height);
 
-        // Create an Intel Open Image Denoise device
-        std::cerr << '\r' << "creating devices                       " << std::flush;
-        oidn::DeviceRef device = oidn::newDevice();
-        device.commit();
-
-        convertSDRtoHDR(inputSDR, inputHDR);
-        convertSDRtoHDR(albedoSDR, albedoHDR);
-        convertSDRtoHDR(normalSDR, normalHDR);
-
-        // Create a filter for denoising a beauty (color) image using prefiltered auxiliary images too
-        std::cerr << '\r' << "setting beautyfilter                                       " << std::flush;
-        oidn::FilterRef filter = device.newFilter("RT"); // generic ray tracing filter
-        filter.setImage("color",  &inputHDR[0],  oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // beauty
-        filter.setImage("albedo", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // auxiliary
-        filter.setImage("normal", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // auxiliary
-        filter.setImage("output", &outputHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width); // denoised beauty
-        filter.set("hdr", true); // beauty image is HDR
-        filter.set("cleanAux", false); // auxiliary images will be prefiltered
-        filter.commit();
-
-        // Create a separate filter for denoising an auxiliary albedo image (in-place)
-        std::cerr << '\r' << "setting prefilter albedo                                       " << std::flush;
-        oidn::FilterRef albedoFilter = device.newFilter("RT"); // same filter type as for beauty
-        albedoFilter.setImage("albedo", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
-        albedoFilter.setImage("output", &albedoHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
-        albedoFilter.commit();
-
-        // Create a separate filter for denoising an auxiliary normal image (in-place)
-        std::cerr << '\r' << "setting prefilter normal                                       " << std::flush;
-        oidn::FilterRef normalFilter = device.newFilter("RT"); // same filter type as for beauty
-        normalFilter.setImage("normal", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
-        normalFilter.setImage("output", &normalHDR[0], oidn::Format::Float3, image_width, image_height, 0, 0, 0 * image_width);
-        normalFilter.commit();
-
-        // Prefilter the auxiliary images
-        std::cerr << '\r' << "prefiltering albedo                                       " << std::flush;
-        albedoFilter.execute();
-        std::cerr << '\r' << "prefiltering normals                                      " << std::flush;
-        normalFilter.execute();
-
-        // // Filter the beauty image
-        std::cerr << '\r' << "denoising beauty image                                    " << std::flush;
-        filter.execute();
-        std::cerr << '\r' << "denoised beauty image                                     " << std::flush;
-
-        // Check for errors
-        const char* errorMessage;
-        if (device.getError(errorMessage) != oidn::Error::None)
-            std::cerr << "\nError: " << errorMessage << std::endl;
-        
-        convertHDRtoSDR(inputHDR, inputSDR);
-        convertHDRtoSDR(outputHDR, outputSDR);
-        convertHDRtoSDR(albedoHDR, albedoSDR);
-        convertHDRtoSDR(normalHDR, normalSDR);
-    #endif
+        toneMap(outputHDR, outputSDR);
+        toneMap(albedoHDR, albedoSDR);
 
-    #ifndef OIDN
-        convertHDRtoSDR(inputHDR, inputSDR);
+        //normals are in [-1, 1] for the denoiser, shifted into [0, 1] for the png
+        for(float& component : normalHDR){
+            component = 0.5f * (component + 1.0f);
+        }
+        toneMap(normalHDR, normalSDR);
     #endif
 
+    toneMap(inputHDR, inputSDR);
+
     #ifdef PNG_OUTPUT
         stbi_write_png("./../output/image.png", image_width, image_height, image_channels, &inputSDR[0], 0);
         #ifdef OIDN
@@ -366,6 +485,15 @@ int main(){
             stbi_write_png("./../output/imageAlbedo.png", image_width, image_height, image_channels, &albedoSDR[0], 0);
             stbi_write_png("./../output/imageNormal.png", image_width, image_height, image_channels, &normalSDR[0], 0);
         #endif
+        #ifdef AOV_OUTPUT
+            std::vector<uint8_t> aovSDR;
+            aovs.writeDepthSDR(aovSDR);
+            stbi_write_png("./../output/imageDepth.png", image_width, image_height, image_channels, &aovSDR[0], 0);
+            aovs.writeIdSDR(aovs.objectId, aovSDR);
+            stbi_write_png("./../output/imageObjectId.png", image_width, image_height, image_channels, &aovSDR[0], 0);
+            aovs.writeIdSDR(aovs.materialId, aovSDR);
+            stbi_write_png("./../output/imageMaterialId.png", image_width, image_height, image_channels, &aovSDR[0], 0);
+        #endif
     #endif
 
 
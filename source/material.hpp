@@ -4,12 +4,33 @@
 #include "rtweekend.hpp"
 #include "hittable.hpp"
 #include "texture.hpp"
+#include "sampler.hpp"
+
+//ids handed out in construction order like the object ids, 0 means no material
+inline uint32_t newMaterialId(){
+    static std::atomic<uint32_t> nextMaterialId{1};
+    return nextMaterialId++;
+}
 
 class material{
 public:
-    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered) const = 0;
+    uint32_t materialId = newMaterialId();
+
+    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const = 0;
     virtual color getAlbedoColor(const ray& rayIncoming, const hitRecord& record, color& attenuation) const = 0;
     virtual color emitted(const float u, const float v, const point3& hitLocation) const { return color(0,0,0); }
+    virtual bool isEmissive() const { return false; }
+    virtual color averageEmission() const { return color(0,0,0); }
+
+    //materials whose scatter direction has a density that evaluate and scatterPdf describe, only they are lit by sampling the lights.
+    //Mirrors, glass and fuzzy metal keep picking up light by hitting it
+    virtual bool samplesLights() const { return false; }
+
+    //bsdf times cosine for light arriving from direction, the attenuation scatter would return divided by its density
+    virtual color evaluate(const ray& rayIncoming, const hitRecord& record, const glm::vec3& direction) const { return color(0,0,0); }
+
+    //solid angle density of scatter choosing direction
+    virtual float scatterPdf(const ray& rayIncoming, const hitRecord& record, const glm::vec3& direction) const { return 0.0f; }
 };
 
 
@@ -27,19 +48,19 @@ public:
         albedoTexture{albedo}
         {}
 
-    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered) const override{
+    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const override{
         glm::vec3 scatterDirection;
 
         #ifdef IN_HEMISPHERE
-            scatterDirection = randomInHemisphere(record.normal);
+            scatterDirection = sampleInHemisphere(record.normal, samples);
         #endif
 
         #ifdef UNIT_SPHERE
-            scatterDirection = record.normal + randomInUnitSphere();
+            scatterDirection = record.normal + sampleInUnitSphere(samples);
         #endif
         
         #ifdef UNIT_VECTOR
-            scatterDirection = record.normal + randomUnitVector();
+            scatterDirection = record.normal + sampleUnitVector(samples);
         #endif
         
         //catch potential cases where scatterDirection == vec3(0,0,0)
@@ -54,6 +75,30 @@ public:
     virtual color getAlbedoColor(const ray& rayIncoming, const hitRecord& record, color& attenuation) const override{
         return albedoTexture->value(record.u, record.v, record.hitLocation);
     }
+
+    //only the unit vector mode samples the cosine density that evaluate and scatterPdf describe
+    virtual bool samplesLights() const override {
+        #ifdef UNIT_VECTOR
+            return true;
+        #else
+            return false;
+        #endif
+    }
+
+    virtual color evaluate(const ray& rayIncoming, const hitRecord& record, const glm::vec3& direction) const override {
+        float cosine = glm::dot(record.normal, glm::normalize(direction));
+        if(cosine <= 0.0f)
+            return color(0,0,0);
+        return albedoTexture->value(record.u, record.v, record.hitLocation) * cosine * static_cast<float>(1.0 / pi);
+    }
+
+    virtual float scatterPdf(const ray& rayIncoming, const hitRecord& record, const glm::vec3& direction) const override {
+        float cosine = glm::dot(record.normal, glm::normalize(direction));
+        if(cosine <= 0.0f)
+            return 0.0f;
+
+        return cosine * static_cast<float>(1.0 / pi);
+    }
 };
 
 
@@ -67,8 +112,8 @@ public:
         roughness{roughness < 1.0f ? roughness : 1.0f}
         {}
 
-    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered) const override {
-        glm::vec3 reflectedDirection = reflect(rayIncoming.direction(), record.normal) + roughness * randomInUnitSphere();
+    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const override {
+        glm::vec3 reflectedDirection = reflect(rayIncoming.direction(), record.normal) + roughness * sampleInUnitSphere(samples);
         rayScattered = ray(record.hitLocation, reflectedDirection, rayIncoming.hitTime());
         attenuation = albedo;
         return glm::dot(reflectedDirection, record.normal) > 0;
@@ -96,7 +141,7 @@ public:
         albedo{color(1,1,1)}
         {}
 
-    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered) const override {
+    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const override {
         attenuation = color(1.0, 1.0, 1.0);
         float refractionRatio = record.frontFace ? (1.0 / refractionIndex) : refractionIndex;
 
@@ -105,7 +150,7 @@ public:
 
         bool cantRefract = refractionRatio * sinTheta > 1.0;
         glm::vec3 refractionDirection;
-        if(cantRefract || reflectance(cosTheta, refractionRatio) > randomFloat(sharedRng)){
+        if(cantRefract || reflectance(cosTheta, refractionRatio) > samples.get1D()){
             refractionDirection = reflect(rayIncoming.direction(), record.normal);
         }
         else{
@@ -138,7 +183,7 @@ public:
         strength{strength}
         {}
 
-    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered) const override{
+    virtual bool scatter(const ray& rayIncoming, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const override{
         return false;
     }
 
@@ -149,6 +194,12 @@ public:
     virtual color getAlbedoColor(const ray& rayIncoming, const hitRecord& record, color& attenuation) const override {
         return emmision->value(record.u, record.v, record.hitLocation);
     }
+
+    virtual bool isEmissive() const override { return true; }
+
+    virtual color averageEmission() const override {
+        return strength * emmision->averageValue();
+    }
 };
 
 
@@ -165,8 +216,8 @@ public:
         albedo{std::make_shared<solidColorTexture>(materialColor)}
     {}
 
-    virtual bool scatter(const ray& r, const hitRecord& record, color& attenuation, ray& rayScattered) const override {
-        rayScattered = ray(record.hitLocation, randomInUnitSphere(), r.hitTime());
+    virtual bool scatter(const ray& r, const hitRecord& record, color& attenuation, ray& rayScattered, sampler& samples) const override {
+        rayScattered = ray(record.hitLocation, sampleInUnitSphere(samples), r.hitTime());
         attenuation = albedo->value(record.u, record.v, record.hitLocation);
         return true;
     }
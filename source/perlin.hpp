@@ -11,21 +11,21 @@ private:
     int* permY;
     int* permZ;
 
-    static int* perlinGeneratePerm(){
+    static int* perlinGeneratePerm(pcg32& rng){
         auto p = new int[pointCount];
         
         for(int i = 0; i < perlin::pointCount; i++){
             p[i] = i;
         }
         
-        permute(p, pointCount);
+        permute(p, pointCount, rng);
 
         return p;
     }
 
-    static void permute(int* p, int n){
+    static void permute(int* p, int n, pcg32& rng){
         for(int i = n - 1; i > 0; i--){
-            int target = randomInt(sharedRng, 0, i + 1);
+            int target = randomInt(rng, 0, i + 1);
             int temp = p[i];
             p[i] = p[target];
             p[target] = temp;
@@ -56,15 +56,18 @@ private:
     }
 
 public:
-    perlin(){
+    //the noise is fixed by the seed so the same scene always gets the same texture
+    perlin(uint64_t seed = 0){
+        pcg32 rng(seed);
+
         randomVec3Array = new glm::vec3[pointCount];
         for(int i = 0; i < pointCount; i++){
-            randomVec3Array[i] = randomUnitVector();
+            randomVec3Array[i] = randomUnitVector(rng);
         }
 
-        permX = perlinGeneratePerm();
-        permY = perlinGeneratePerm();
-        permZ = perlinGeneratePerm();
+        permX = perlinGeneratePerm(rng);
+        permY = perlinGeneratePerm(rng);
+        permZ = perlinGeneratePerm(rng);
     }
 
     ~perlin(){
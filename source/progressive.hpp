@@ -0,0 +1,83 @@
+#ifndef PROGRESSIVE_HPP
+#define PROGRESSIVE_HPP
+
+#include <iostream>
+#include <chrono>
+#include <functional>
+#include "rtweekend.hpp"
+#include "framebuffer.hpp"
+#include "tileScheduler.hpp"
+
+struct progressiveSettings{
+    int samplesPerPass = 4;         //samples added to every pixel per pass over the image
+    int targetSampleCount = 0;      //stop once every pixel has this many samples, 0 for no target
+    double timeBudget = 0.0;        //seconds, the render stops before a pass that would not fit anymore, 0 for no limit
+    double snapshotInterval = 5.0;  //seconds between snapshots, 0 disables them
+    bool denoiseSnapshots = false;  //run the denoiser on every snapshot, needs OIDN
+    double checkpointInterval = 0.0;    //seconds between checkpoints, the last pass always writes one when checkpointing is enabled
+};
+
+//renders the whole image in passes of samplesPerPass samples until the sample target or the time budget is reached,
+//each pass continues the sample sequence of the one before so the result equals a single render with the same sample count.
+//snapshot and checkpoint are called between passes, no thread writes to the buffers then. A render resumed from a checkpoint
+//passes the samples per pixel already in the buffers as startSampleCount. Returns the samples per pixel reached
+inline int renderProgressive(const std::vector<imageTile>& tiles, int threadCount, const renderSettings& settings, const progressiveSettings& progressive,
+                             renderFunction renderer, framebuffer& output, aovBuffers* aovs, const camera& worldCamera, const hittableList& world,
+                             const std::function<void(int sampleCount)>& snapshot, const std::function<void(int sampleCount)>& checkpoint = nullptr,
+                             int startSampleCount = 0){
+    const int samplesPerPass = std::max(1, progressive.samplesPerPass);
+    //without any stopping condition a single pass is rendered
+    const int targetSampleCount = (progressive.targetSampleCount <= 0 && progressive.timeBudget <= 0.0) ? samplesPerPass : progressive.targetSampleCount;
+
+    const auto renderStart = std::chrono::steady_clock::now();
+    auto lastSnapshot = renderStart;
+    auto lastCheckpoint = renderStart;
+    int sampleCount = startSampleCount;
+    int passCount = 0;
+
+    renderSettings pass = settings;
+    pass.sampleBudget = targetSampleCount;
+
+    while(targetSampleCount <= 0 || sampleCount < targetSampleCount){
+        pass.sampleStart = sampleCount;
+        pass.pixelSampleCount = targetSampleCount > 0 ? std::min(samplesPerPass, targetSampleCount - sampleCount) : samplesPerPass;
+
+        const auto passStart = std::chrono::steady_clock::now();
+        renderTiles(tiles, threadCount, [&](const imageTile& tile, int worker){
+            renderer(tile, pass, output, aovs, worldCamera, world);
+        });
+        const auto passEnd = std::chrono::steady_clock::now();
+
+        sampleCount += pass.pixelSampleCount;
+        passCount++;
+
+        std::chrono::duration<double> passTime = passEnd - passStart;
+        std::chrono::duration<double> elapsed = passEnd - renderStart;
+        std::cerr << "\rPass " << passCount << ": " << sampleCount << " samples per pixel after " << elapsed.count() << " s" << std::flush;
+
+        //passes take about the same time, stop if the next one would overrun the budget
+        if(progressive.timeBudget > 0.0 && elapsed.count() + passTime.count() > progressive.timeBudget)
+            break;
+
+        std::chrono::duration<double> sinceCheckpoint = passEnd - lastCheckpoint;
+        if(checkpoint && progressive.checkpointInterval > 0.0 && sinceCheckpoint.count() >= progressive.checkpointInterval && sampleCount != targetSampleCount){
+            checkpoint(sampleCount);
+            lastCheckpoint = std::chrono::steady_clock::now();
+        }
+
+        std::chrono::duration<double> sinceSnapshot = passEnd - lastSnapshot;
+        if(progressive.snapshotInterval > 0.0 && sinceSnapshot.count() >= progressive.snapshotInterval && sampleCount != targetSampleCount){
+            snapshot(sampleCount);
+            lastSnapshot = std::chrono::steady_clock::now();
+        }
+    }
+
+    //a render stopped by the budget can be continued later with more time, a finished one has nothing left to continue
+    if(checkpoint && (targetSampleCount <= 0 || sampleCount < targetSampleCount))
+        checkpoint(sampleCount);
+
+    std::cerr << "\n" << std::flush;
+    return sampleCount;
+}
+
+#endif //PROGRESSIVE_HPP
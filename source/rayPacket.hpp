@@ -0,0 +1,167 @@
+#ifndef RAY_PACKET_HPP
+#define RAY_PACKET_HPP
+
+#include <algorithm>
+#include "ray.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define RAY_PACKET_SSE
+    #include <emmintrin.h>
+#endif
+
+//8 coherent rays in SoA layout, lanes are addressed through bitmasks
+struct alignas(16) rayPacket{
+    static const int width = 8;
+    static const int fullMask = (1 << width) - 1;
+
+    float originX[width], originY[width], originZ[width];
+    float directionX[width], directionY[width], directionZ[width];
+    float inverseX[width], inverseY[width], inverseZ[width];
+    float time[width];
+    ray rays[width];
+
+    int laneMask = 0;
+
+    //all active rays share a direction octant, only then the interval bounds below are used to cull whole nodes
+    bool coherent = false;
+    glm::vec3 originMin, originMax;
+    glm::vec3 inverseMin, inverseMax;
+
+    void setRay(int lane, const ray& r){
+        rays[lane] = r;
+
+        originX[lane] = r.origin().x;
+        originY[lane] = r.origin().y;
+        originZ[lane] = r.origin().z;
+        directionX[lane] = r.direction().x;
+        directionY[lane] = r.direction().y;
+        directionZ[lane] = r.direction().z;
+        inverseX[lane] = 1.0f / directionX[lane];
+        inverseY[lane] = 1.0f / directionY[lane];
+        inverseZ[lane] = 1.0f / directionZ[lane];
+        time[lane] = r.hitTime();
+
+        laneMask |= 1 << lane;
+    }
+
+    //pads unused lanes with a copy of an active ray so SIMD kernels never read garbage, then computes the packet bounds
+    void finalize(){
+        if(laneMask == 0)
+            return;
+
+        int firstLane = 0;
+        while(!(laneMask & (1 << firstLane))) firstLane++;
+
+        for(int lane = 0; lane < width; lane++){
+            if(laneMask & (1 << lane))
+                continue;
+
+            originX[lane] = originX[firstLane]; originY[lane] = originY[firstLane]; originZ[lane] = originZ[firstLane];
+            directionX[lane] = directionX[firstLane]; directionY[lane] = directionY[firstLane]; directionZ[lane] = directionZ[firstLane];
+            inverseX[lane] = inverseX[firstLane]; inverseY[lane] = inverseY[firstLane]; inverseZ[lane] = inverseZ[firstLane];
+            time[lane] = time[firstLane];
+            rays[lane] = rays[firstLane];
+        }
+
+        originMin = originMax = glm::vec3(originX[0], originY[0], originZ[0]);
+        inverseMin = inverseMax = glm::vec3(inverseX[0], inverseY[0], inverseZ[0]);
+        coherent = true;
+
+        for(int lane = 1; lane < width; lane++){
+            glm::vec3 origin(originX[lane], originY[lane], originZ[lane]);
+            glm::vec3 inverse(inverseX[lane], inverseY[lane], inverseZ[lane]);
+
+            originMin = glm::min(originMin, origin);
+            originMax = glm::max(originMax, origin);
+            inverseMin = glm::min(inverseMin, inverse);
+            inverseMax = glm::max(inverseMax, inverse);
+        }
+
+        for(int dimension = 0; dimension < 3; dimension++){
+            bool signsDiffer = (inverseMin[dimension] < 0.0f) != (inverseMax[dimension] < 0.0f);
+            if(signsDiffer || std::isinf(inverseMin[dimension]) || std::isinf(inverseMax[dimension]))
+                coherent = false;
+        }
+    }
+
+    //conservative test of the whole packet against a box, false means every ray misses it
+    bool intervalHitsBox(const float boundsMin[3], const float boundsMax[3], float distMin, float distMax) const {
+        float tNear = distMin;
+        float tFar = distMax;
+
+        for(int dimension = 0; dimension < 3; dimension++){
+            bool negative = inverseMin[dimension] < 0.0f;
+            float entryPlane = negative ? boundsMax[dimension] : boundsMin[dimension];
+            float exitPlane  = negative ? boundsMin[dimension] : boundsMax[dimension];
+
+            //interval products [plane - originMax, plane - originMin] * [inverseMin, inverseMax]
+            float entryLow  = entryPlane - originMax[dimension];
+            float entryHigh = entryPlane - originMin[dimension];
+            float exitLow   = exitPlane - originMax[dimension];
+            float exitHigh  = exitPlane - originMin[dimension];
+
+            float entryMin = std::min(std::min(entryLow * inverseMin[dimension], entryLow * inverseMax[dimension]), std::min(entryHigh * inverseMin[dimension], entryHigh * inverseMax[dimension]));
+            float exitMax  = std::max(std::max(exitLow * inverseMin[dimension], exitLow * inverseMax[dimension]), std::max(exitHigh * inverseMin[dimension], exitHigh * inverseMax[dimension]));
+
+            tNear = std::max(tNear, entryMin);
+            tFar = std::min(tFar, exitMax);
+        }
+
+        return tNear <= tFar * (1.0f + 4.0f * std::numeric_limits<float>::epsilon());
+    }
+
+    //exact per lane slab test, returns the mask of lanes in activeMask that overlap the box within their own [distMin, distMax]
+    int lanesHitBox(const float boundsMin[3], const float boundsMax[3], float distMin, const float distMax[width], int activeMask) const {
+        int hitMask = 0;
+
+#ifdef RAY_PACKET_SSE
+        const __m128 minX = _mm_set1_ps(boundsMin[0]), maxX = _mm_set1_ps(boundsMax[0]);
+        const __m128 minY = _mm_set1_ps(boundsMin[1]), maxY = _mm_set1_ps(boundsMax[1]);
+        const __m128 minZ = _mm_set1_ps(boundsMin[2]), maxZ = _mm_set1_ps(boundsMax[2]);
+        const __m128 widen = _mm_set1_ps(1.0f + 4.0f * std::numeric_limits<float>::epsilon());
+
+        for(int half = 0; half < width; half += 4){
+            if(!((activeMask >> half) & 0xF))
+                continue;
+
+            __m128 ox = _mm_loadu_ps(originX + half), oy = _mm_loadu_ps(originY + half), oz = _mm_loadu_ps(originZ + half);
+            __m128 ix = _mm_loadu_ps(inverseX + half), iy = _mm_loadu_ps(inverseY + half), iz = _mm_loadu_ps(inverseZ + half);
+
+            __m128 t0x = _mm_mul_ps(_mm_sub_ps(minX, ox), ix), t1x = _mm_mul_ps(_mm_sub_ps(maxX, ox), ix);
+            __m128 t0y = _mm_mul_ps(_mm_sub_ps(minY, oy), iy), t1y = _mm_mul_ps(_mm_sub_ps(maxY, oy), iy);
+            __m128 t0z = _mm_mul_ps(_mm_sub_ps(minZ, oz), iz), t1z = _mm_mul_ps(_mm_sub_ps(maxZ, oz), iz);
+
+            __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_set1_ps(distMin)));
+            __m128 tFar  = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_loadu_ps(distMax + half)));
+
+            hitMask |= _mm_movemask_ps(_mm_cmple_ps(tNear, _mm_mul_ps(tFar, widen))) << half;
+        }
+#else
+        for(int lane = 0; lane < width; lane++){
+            const float origin[3] = { originX[lane], originY[lane], originZ[lane] };
+            const float inverse[3] = { inverseX[lane], inverseY[lane], inverseZ[lane] };
+            float tNear = distMin;
+            float tFar = distMax[lane];
+
+            for(int dimension = 0; dimension < 3; dimension++){
+                float t0 = (boundsMin[dimension] - origin[dimension]) * inverse[dimension];
+                float t1 = (boundsMax[dimension] - origin[dimension]) * inverse[dimension];
+                tNear = std::max(tNear, std::min(t0, t1));
+                tFar = std::min(tFar, std::max(t0, t1));
+            }
+
+            hitMask |= (tNear <= tFar * (1.0f + 4.0f * std::numeric_limits<float>::epsilon())) ? (1 << lane) : 0;
+        }
+#endif
+
+        return hitMask & activeMask;
+    }
+};
+
+inline int laneCount(int mask){
+    int count = 0;
+    for(; mask; mask &= mask - 1) count++;
+    return count;
+}
+
+#endif //RAY_PACKET_HPP
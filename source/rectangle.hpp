@@ -2,9 +2,85 @@
 #define RECTANGLE_HPP
 
 #include "hittable.hpp"
+#include "material.hpp"
+
+//SIMD kernel shared by the three axis aligned rectangles, axes index the x/y/z arrays of the packet
+inline int rectanglePacketMask(const rayPacket& packet, int activeMask, int constAxis, int axisA, int axisB, float constValue,
+                               float minA, float maxA, float minB, float maxB, float tStart, float tEnd, const glm::vec3& displacement,
+                               float distMin, const float distMax[rayPacket::width], float distances[rayPacket::width]){
+    const float* origins[3] = { packet.originX, packet.originY, packet.originZ };
+    const float* directions[3] = { packet.directionX, packet.directionY, packet.directionZ };
+    const float* inverses[3] = { packet.inverseX, packet.inverseY, packet.inverseZ };
+    int hitMask = 0;
+
+#ifdef RAY_PACKET_SSE
+    const __m128 startTime = _mm_set1_ps(tStart);
+    const __m128 inverseDuration = _mm_set1_ps(1.0f / (tEnd - tStart));
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    for(int half = 0; half < rayPacket::width; half += 4){
+        if(!((activeMask >> half) & 0xF))
+            continue;
+
+        __m128 factor = _mm_min_ps(one, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet.time + half), startTime), inverseDuration));
+        __m128 deltaConst = _mm_mul_ps(factor, _mm_set1_ps(displacement[constAxis]));
+        __m128 deltaA = _mm_mul_ps(factor, _mm_set1_ps(displacement[axisA]));
+        __m128 deltaB = _mm_mul_ps(factor, _mm_set1_ps(displacement[axisB]));
+
+        __m128 distance = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(constValue), deltaConst), _mm_loadu_ps(origins[constAxis] + half)), _mm_loadu_ps(inverses[constAxis] + half));
+        __m128 positionA = _mm_add_ps(_mm_loadu_ps(origins[axisA] + half), _mm_mul_ps(_mm_loadu_ps(directions[axisA] + half), distance));
+        __m128 positionB = _mm_add_ps(_mm_loadu_ps(origins[axisB] + half), _mm_mul_ps(_mm_loadu_ps(directions[axisB] + half), distance));
+
+        __m128 inside = _mm_and_ps(_mm_cmpge_ps(distance, _mm_set1_ps(distMin)), _mm_cmple_ps(distance, _mm_loadu_ps(distMax + half)));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(positionA, _mm_add_ps(_mm_set1_ps(minA), deltaA)), _mm_cmple_ps(positionA, _mm_add_ps(_mm_set1_ps(maxA), deltaA))));
+        inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(positionB, _mm_add_ps(_mm_set1_ps(minB), deltaB)), _mm_cmple_ps(positionB, _mm_add_ps(_mm_set1_ps(maxB), deltaB))));
+
+        _mm_storeu_ps(distances + half, distance);
+        hitMask |= _mm_movemask_ps(inside) << half;
+    }
+#else
+    for(int lane = 0; lane < rayPacket::width; lane++){
+        float factor = std::min(1.0f, (packet.time[lane] - tStart) / (tEnd - tStart));
+        float distance = (constValue + factor * displacement[constAxis] - origins[constAxis][lane]) * inverses[constAxis][lane];
+        float positionA = origins[axisA][lane] + directions[axisA][lane] * distance;
+        float positionB = origins[axisB][lane] + directions[axisB][lane] * distance;
+
+        distances[lane] = distance;
+        bool inside = distance >= distMin && distance <= distMax[lane] &&
+                      positionA >= minA + factor * displacement[axisA] && positionA <= maxA + factor * displacement[axisA] &&
+                      positionB >= minB + factor * displacement[axisB] && positionB <= maxB + factor * displacement[axisB];
+        hitMask |= inside ? (1 << lane) : 0;
+    }
+#endif
+
+    return hitMask & activeMask;
+}
+
+//solid angle density of picking a point uniformly on a rectangle of the given area, seen along direction at the ray distance,
+//both sides of the rectangle emit so the cosine is taken by magnitude
+inline float rectangleLightPdf(const glm::vec3& direction, float distance, float area, int constAxis){
+    float directionLengthSquared = glm::dot(direction, direction);
+    float cosine = std::fabs(direction[constAxis]) / std::sqrt(directionLengthSquared);
+    if(cosine < 1e-6f)
+        return 0.0f;
+
+    return distance * distance * directionLengthSquared / (cosine * area);
+}
+
+//both sides emit around the normal along constAxis
+inline bool rectangleLightBounds(const hittable& rectangle, const std::shared_ptr<material>& mat, float area, int constAxis, float tStart, float tEnd, lightBounds& bounds){
+    axisAlignedBoundingBox box;
+    rectangle.boundingBox(tStart, tEnd, box);
+    glm::vec3 normal(0,0,0);
+    normal[constAxis] = 1.0f;
+    bounds = lightBounds(box, normal, luminance(mat->averageEmission()) * 2.0f * area, 1.0f, 0.0f, true);
+    return !bounds.empty();
+}
 
 class rectangleXY : public hittable{
 private:
+    friend class compiledScene;
+
     float leftX, rightX;
     float bottomY, topY;
     float constZ;
@@ -12,21 +88,11 @@ private:
     glm::vec3 displacement;
     std::shared_ptr<material> mat;
 
-public:
-    rectangleXY(float leftX, float rightX, float bottomY, float topY, float constZ, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
-    leftX{leftX}, rightX{rightX},
-    bottomY{bottomY}, topY{topY},
-    constZ{constZ},
-    mat{mat},
-    tStart{tStart}, tEnd{tEnd},
-    displacement{displacement}
-    {}
-
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+    bool intersectDistance(const ray& r, float distMin, float distMax, float& distance) const {
         glm::vec3 delta = std::min(1.0f, ((r.hitTime() - tStart) / (tEnd - tStart))) * displacement;
         point3 origin = r.origin();
         glm::vec3 rayDirection = r.direction();
-        float distance = (constZ + delta.z - origin.z) / rayDirection.z;
+        distance = (constZ + delta.z - origin.z) / rayDirection.z;
         if(distance < distMin || distance > distMax)
             return false;
 
@@ -35,16 +101,70 @@ public:
         if(rayX < leftX + delta.x || rayX > rightX + delta.x || rayY < bottomY + delta.y || rayY > topY + delta.y)
             return false;
 
+        return true;
+    }
+
+    void setHitRecord(const ray& r, float distance, hitRecord& record) const {
         record.distance = distance;
         record.hitLocation = r.at(distance);
         record.materialPointer = mat;
+        record.objectId = objectId;
         record.setFaceNormal(r, glm::vec3(0,0,1));
-        record.u = (rayX - leftX) / (rightX - leftX);
-        record.v = (rayY - bottomY) / (topY - bottomY);
+        record.u = (record.hitLocation.x - leftX) / (rightX - leftX);
+        record.v = (record.hitLocation.y - bottomY) / (topY - bottomY);
+    }
 
+public:
+    rectangleXY(float leftX, float rightX, float bottomY, float topY, float constZ, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
+    leftX{leftX}, rightX{rightX},
+    bottomY{bottomY}, topY{topY},
+    constZ{constZ},
+    mat{mat},
+    tStart{tStart}, tEnd{tEnd},
+    displacement{displacement}
+    {}
+
+    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        setHitRecord(r, distance, record);
         return true;
     }
 
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        query.claim(this, distance);
+        return true;
+    }
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override{
+        float distance;
+        return intersectDistance(r, distMin, distMax, distance);
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override{
+        setHitRecord(r, query.distance, record);
+    }
+
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override {
+        float distances[rayPacket::width];
+        int hitMask = rectanglePacketMask(packet, activeMask, 2, 0, 1, constZ, leftX, rightX, bottomY, topY, tStart, tEnd, displacement, distMin, distMax, distances);
+
+        for(int lane = 0; lane < rayPacket::width; lane++){
+            if(hitMask & (1 << lane)){
+                setHitRecord(packet.rays[lane], distances[lane], records[lane]);
+                distMax[lane] = distances[lane];
+            }
+        }
+
+        return hitMask;
+    }
+
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override{
         float epsilon = 0.0001;
         axisAlignedBoundingBox box1(glm::vec3(leftX, bottomY, constZ - epsilon), glm::vec3(rightX, topY, constZ + epsilon));
@@ -54,10 +174,33 @@ public:
         return true;
     }
 
+    virtual bool emitsLight() const override {
+        return mat && mat->isEmissive();
+    }
+
+    virtual float pdfValue(const point3& origin, const glm::vec3& direction, float time) const override {
+        float distance;
+        if(!intersectDistance(ray(origin, direction, time), 0.001, infinity, distance))
+            return 0.0f;
+
+        return rectangleLightPdf(direction, distance, (rightX - leftX) * (topY - bottomY), 2);
+    }
+
+    virtual bool getLightBounds(float tStart, float tEnd, lightBounds& bounds) const override {
+        return rectangleLightBounds(*this, mat, (rightX - leftX) * (topY - bottomY), 2, tStart, tEnd, bounds);
+    }
+
+    virtual glm::vec3 sampleDirection(const point3& origin, const glm::vec2& sample, float time) const override {
+        glm::vec3 delta = std::min(1.0f, ((time - tStart) / (tEnd - tStart))) * displacement;
+        return point3(leftX + sample.x * (rightX - leftX), bottomY + sample.y * (topY - bottomY), constZ) + delta - origin;
+    }
+
 };
 
 class rectangleXZ : public hittable{
 private:
+    friend class compiledScene;
+
     float leftX, rightX;
     float frontZ, backZ;
     float constY;
@@ -65,21 +208,11 @@ private:
     glm::vec3 displacement;
     std::shared_ptr<material> mat;
 
-public:
-    rectangleXZ(float leftX, float rightX, float frontZ, float backZ, float constY, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
-    leftX{leftX}, rightX{rightX},
-    frontZ{frontZ}, backZ{backZ},
-    constY{constY},
-    mat{mat},
-    tStart{tStart}, tEnd{tEnd},
-    displacement{displacement}
-    {}
-
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+    bool intersectDistance(const ray& r, float distMin, float distMax, float& distance) const {
         glm::vec3 delta = std::min(1.0f, ((r.hitTime() - tStart) / (tEnd - tStart))) * displacement;
         point3 origin = r.origin();
         glm::vec3 rayDirection = r.direction();
-        float distance = (constY + delta.y - origin.y) / rayDirection.y;
+        distance = (constY + delta.y - origin.y) / rayDirection.y;
         if(distance < distMin || distance > distMax)
             return false;
 
@@ -88,16 +221,70 @@ public:
         if(rayX < leftX + delta.x || rayX > rightX + delta.x || rayZ < frontZ + delta.z || rayZ > backZ + delta.z)
             return false;
 
+        return true;
+    }
+
+    void setHitRecord(const ray& r, float distance, hitRecord& record) const {
         record.distance = distance;
         record.hitLocation = r.at(distance);
         record.materialPointer = mat;
+        record.objectId = objectId;
         record.setFaceNormal(r, glm::vec3(0,1,0));
-        record.u = (rayX - leftX) / (rightX - leftX);
-        record.v = (rayZ - frontZ) / (backZ - frontZ);
+        record.u = (record.hitLocation.x - leftX) / (rightX - leftX);
+        record.v = (record.hitLocation.z - frontZ) / (backZ - frontZ);
+    }
+
+public:
+    rectangleXZ(float leftX, float rightX, float frontZ, float backZ, float constY, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
+    leftX{leftX}, rightX{rightX},
+    frontZ{frontZ}, backZ{backZ},
+    constY{constY},
+    mat{mat},
+    tStart{tStart}, tEnd{tEnd},
+    displacement{displacement}
+    {}
 
+    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        setHitRecord(r, distance, record);
+        return true;
+    }
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        query.claim(this, distance);
         return true;
     }
 
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override{
+        float distance;
+        return intersectDistance(r, distMin, distMax, distance);
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override{
+        setHitRecord(r, query.distance, record);
+    }
+
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override {
+        float distances[rayPacket::width];
+        int hitMask = rectanglePacketMask(packet, activeMask, 1, 0, 2, constY, leftX, rightX, frontZ, backZ, tStart, tEnd, displacement, distMin, distMax, distances);
+
+        for(int lane = 0; lane < rayPacket::width; lane++){
+            if(hitMask & (1 << lane)){
+                setHitRecord(packet.rays[lane], distances[lane], records[lane]);
+                distMax[lane] = distances[lane];
+            }
+        }
+
+        return hitMask;
+    }
+
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override{
         float epsilon = 0.0001;
         axisAlignedBoundingBox box1(glm::vec3(leftX, constY - epsilon, frontZ), glm::vec3(rightX, constY + epsilon, backZ));
@@ -106,11 +293,34 @@ public:
         
         return true;
     }
-    
+
+    virtual bool emitsLight() const override {
+        return mat && mat->isEmissive();
+    }
+
+    virtual float pdfValue(const point3& origin, const glm::vec3& direction, float time) const override {
+        float distance;
+        if(!intersectDistance(ray(origin, direction, time), 0.001, infinity, distance))
+            return 0.0f;
+
+        return rectangleLightPdf(direction, distance, (rightX - leftX) * (backZ - frontZ), 1);
+    }
+
+    virtual bool getLightBounds(float tStart, float tEnd, lightBounds& bounds) const override {
+        return rectangleLightBounds(*this, mat, (rightX - leftX) * (backZ - frontZ), 1, tStart, tEnd, bounds);
+    }
+
+    virtual glm::vec3 sampleDirection(const point3& origin, const glm::vec2& sample, float time) const override {
+        glm::vec3 delta = std::min(1.0f, ((time - tStart) / (tEnd - tStart))) * displacement;
+        return point3(leftX + sample.x * (rightX - leftX), constY, frontZ + sample.y * (backZ - frontZ)) + delta - origin;
+    }
+
 };
 
 class rectangleYZ : public hittable{
 private:
+    friend class compiledScene;
+
     float bottomY, topY;
     float frontZ, backZ;
     float constX;
@@ -118,21 +328,11 @@ private:
     glm::vec3 displacement;
     std::shared_ptr<material> mat;
 
-public:
-    rectangleYZ(float bottomY, float topY, float frontZ, float backZ, float constX, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
-    bottomY{bottomY}, topY{topY},
-    frontZ{frontZ}, backZ{backZ},
-    constX{constX},
-    mat{mat},
-    tStart{tStart}, tEnd{tEnd},
-    displacement{displacement}
-    {}
-
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+    bool intersectDistance(const ray& r, float distMin, float distMax, float& distance) const {
         glm::vec3 delta = std::min(1.0f, ((r.hitTime() - tStart) / (tEnd - tStart))) * displacement;
         point3 origin = r.origin();
         glm::vec3 rayDirection = r.direction();
-        float distance = (constX + delta.x - origin.x) / rayDirection.x;
+        distance = (constX + delta.x - origin.x) / rayDirection.x;
         if(distance < distMin || distance > distMax)
             return false;
 
@@ -141,16 +341,70 @@ public:
         if(rayY < bottomY + delta.y || rayY > topY + delta.y || rayZ < frontZ + delta.z || rayZ > backZ + delta.z)
             return false;
 
+        return true;
+    }
+
+    void setHitRecord(const ray& r, float distance, hitRecord& record) const {
         record.distance = distance;
         record.hitLocation = r.at(distance);
         record.materialPointer = mat;
+        record.objectId = objectId;
         record.setFaceNormal(r, glm::vec3(1,0,0));
-        record.u = (rayY - bottomY) / (topY - bottomY);
-        record.v = (rayZ - frontZ) / (backZ - frontZ);
+        record.u = (record.hitLocation.y - bottomY) / (topY - bottomY);
+        record.v = (record.hitLocation.z - frontZ) / (backZ - frontZ);
+    }
 
+public:
+    rectangleYZ(float bottomY, float topY, float frontZ, float backZ, float constX, std::shared_ptr<material> mat, float tStart = 0.0, float tEnd = 1.0, const glm::vec3& displacement = glm::vec3(0,0,0)):
+    bottomY{bottomY}, topY{topY},
+    frontZ{frontZ}, backZ{backZ},
+    constX{constX},
+    mat{mat},
+    tStart{tStart}, tEnd{tEnd},
+    displacement{displacement}
+    {}
+
+    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        setHitRecord(r, distance, record);
+        return true;
+    }
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override{
+        float distance;
+        if(!intersectDistance(r, distMin, distMax, distance))
+            return false;
+
+        query.claim(this, distance);
         return true;
     }
 
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override{
+        float distance;
+        return intersectDistance(r, distMin, distMax, distance);
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override{
+        setHitRecord(r, query.distance, record);
+    }
+
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override {
+        float distances[rayPacket::width];
+        int hitMask = rectanglePacketMask(packet, activeMask, 0, 1, 2, constX, bottomY, topY, frontZ, backZ, tStart, tEnd, displacement, distMin, distMax, distances);
+
+        for(int lane = 0; lane < rayPacket::width; lane++){
+            if(hitMask & (1 << lane)){
+                setHitRecord(packet.rays[lane], distances[lane], records[lane]);
+                distMax[lane] = distances[lane];
+            }
+        }
+
+        return hitMask;
+    }
+
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override{
         float epsilon = 0.0001;
         axisAlignedBoundingBox box1(glm::vec3(constX - epsilon, bottomY, frontZ), glm::vec3(constX + epsilon, topY, backZ));
@@ -160,6 +414,27 @@ public:
         return true;
     }
 
+    virtual bool emitsLight() const override {
+        return mat && mat->isEmissive();
+    }
+
+    virtual float pdfValue(const point3& origin, const glm::vec3& direction, float time) const override {
+        float distance;
+        if(!intersectDistance(ray(origin, direction, time), 0.001, infinity, distance))
+            return 0.0f;
+
+        return rectangleLightPdf(direction, distance, (topY - bottomY) * (backZ - frontZ), 0);
+    }
+
+    virtual bool getLightBounds(float tStart, float tEnd, lightBounds& bounds) const override {
+        return rectangleLightBounds(*this, mat, (topY - bottomY) * (backZ - frontZ), 0, tStart, tEnd, bounds);
+    }
+
+    virtual glm::vec3 sampleDirection(const point3& origin, const glm::vec2& sample, float time) const override {
+        glm::vec3 delta = std::min(1.0f, ((time - tStart) / (tEnd - tStart))) * displacement;
+        return point3(constX, bottomY + sample.x * (topY - bottomY), frontZ + sample.y * (backZ - frontZ)) + delta - origin;
+    }
+
 };
 
 class rectangle : public hittable{
@@ -175,6 +450,8 @@ public:
 
 class box : public hittable{
 private:
+    friend class compiledScene;
+
     point3 minCorner;
     point3 maxCorner;
     hittableList sides;
@@ -197,8 +474,16 @@ public:
         sides.add(std::make_shared<rectangleYZ>(minCorner.y, maxCorner.y, minCorner.z, maxCorner.z, minCorner.x, mat, tStart, tEnd, displacement));
     }
 
-    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override {
-        return sides.hit(r, distMin, distMax, record);
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
+        return sides.intersect(r, distMin, distMax, query);
+    }
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        return sides.occluded(r, distMin, distMax);
+    }
+
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override {
+        return sides.hitPacket(packet, activeMask, distMin, distMax, records);
     }
 
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
@@ -0,0 +1,83 @@
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <cstdint>
+#include <limits>
+
+//pcg32 (XSH RR variant), 16 bytes of state so every render thread owns its generator instead of sharing one mt19937,
+//different streams with the same seed produce independent sequences
+class pcg32{
+private:
+    static const uint64_t multiplier = 6364136223846793005ULL;
+    uint64_t state;
+    uint64_t increment;
+
+public:
+    typedef uint32_t result_type;
+
+    pcg32(uint64_t seedValue = 0x853c49e6748fea9bULL, uint64_t stream = 0xda3e39cb94b95bdbULL){
+        seed(seedValue, stream);
+    }
+
+    void seed(uint64_t seedValue, uint64_t stream = 0xda3e39cb94b95bdbULL){
+        state = 0;
+        increment = (stream << 1) | 1;
+        nextUint();
+        state += seedValue;
+        nextUint();
+    }
+
+    inline uint32_t nextUint(){
+        uint64_t oldState = state;
+        state = oldState * multiplier + increment;
+        uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18) ^ oldState) >> 27);
+        uint32_t rotation = static_cast<uint32_t>(oldState >> 59);
+        return (xorShifted >> rotation) | (xorShifted << ((~rotation + 1) & 31));
+    }
+
+    //uniform in [0, 1), the top 24 bits fill the float mantissa exactly
+    inline float nextFloat(){
+        return (nextUint() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    //jumps delta steps ahead in O(log delta)
+    void advance(uint64_t delta){
+        uint64_t currentMultiplier = multiplier;
+        uint64_t currentIncrement = increment;
+        uint64_t accumulatedMultiplier = 1;
+        uint64_t accumulatedIncrement = 0;
+
+        while(delta > 0){
+            if(delta & 1){
+                accumulatedMultiplier *= currentMultiplier;
+                accumulatedIncrement = accumulatedIncrement * currentMultiplier + currentIncrement;
+            }
+            currentIncrement = (currentMultiplier + 1) * currentIncrement;
+            currentMultiplier *= currentMultiplier;
+            delta >>= 1;
+        }
+
+        state = accumulatedMultiplier * state + accumulatedIncrement;
+    }
+
+    //lets the generator be used with the standard library distributions and algorithms
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<uint32_t>::max(); }
+    result_type operator()() { return nextUint(); }
+};
+
+//splitmix64 finalizer, spreads structured keys like pixel and sample indices over the whole seed range
+inline uint64_t mixSeed(uint64_t value){
+    value += 0x9e3779b97f4a7c15ULL;
+    value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+    return value ^ (value >> 31);
+}
+
+//seed of one camera sample, only depends on the render seed and the sample's place in the image,
+//not on which thread renders it or in which order
+inline uint64_t sampleKey(uint64_t seed, uint64_t pixel, uint64_t sample){
+    return mixSeed(seed ^ mixSeed(pixel ^ mixSeed(sample)));
+}
+
+#endif //RNG_HPP
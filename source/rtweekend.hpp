@@ -5,27 +5,46 @@
 #include <limits>
 #include <memory>
 #include <random>
+#include <thread>
+#include <vector>
+#include <functional>
 #include "glm/glm.hpp"
+#include "rng.hpp"
 
 //Constants
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
-std::random_device sharedRandomDevice;
-std::mt19937 sharedRng(sharedRandomDevice());
 
 //Utility functions
 inline double degrees_to_radians(double degrees){
     return degrees * pi / 180.0;
 }
 
-inline float randomFloat(std::mt19937& rng, float inclusiveMin = 0.0, float exclusiveMax = 1.0){
-    std::uniform_real_distribution<float> distribution(inclusiveMin, exclusiveMax);
-    return distribution(rng);
+inline float randomFloat(pcg32& rng, float inclusiveMin = 0.0, float exclusiveMax = 1.0){
+    return inclusiveMin + (exclusiveMax - inclusiveMin) * rng.nextFloat();
 }
 
-inline int randomInt(std::mt19937& rng, int inclusiveMin = 0, int exclusiveMax = 1){
-    std::uniform_real_distribution<float> distribution(inclusiveMin, exclusiveMax);
-    return static_cast<int>(distribution(rng));
+inline int randomInt(pcg32& rng, int inclusiveMin = 0, int exclusiveMax = 1){
+    return static_cast<int>(randomFloat(rng, inclusiveMin, exclusiveMax));
+}
+
+//splits [begin, end) into threadCount contiguous chunks and runs them on their own threads, the calling thread takes the first chunk
+inline void parallelFor(uint64_t begin, uint64_t end, int threadCount, const std::function<void(uint64_t chunkBegin, uint64_t chunkEnd, int chunkIndex)>& function){
+    uint64_t length = end - begin;
+    int chunkCount = static_cast<int>(std::max<uint64_t>(1, std::min<uint64_t>(static_cast<uint64_t>(std::max(1, threadCount)), length)));
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunkCount - 1);
+
+    for(int chunk = 1; chunk < chunkCount; chunk++){
+        threads.push_back(std::thread(function, begin + length * chunk / chunkCount, begin + length * (chunk + 1) / chunkCount, chunk));
+    }
+
+    function(begin, begin + length / chunkCount, 0);
+
+    for(std::thread& thread : threads){
+        thread.join();
+    }
 }
 
 inline float clamp(float x, float min, float max){
@@ -0,0 +1,265 @@
+#ifndef SAMPLER_HPP
+#define SAMPLER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include "rtweekend.hpp"
+
+enum class samplerType{
+    independent,    //uniform random numbers
+    stratified,     //correlated multi-jittered 2D and jittered 1D strata over the samples of a pixel
+    sobol,          //padded Owen scrambled sobol, every pixel gets its own scramble
+    blueNoise       //one Owen scrambled sobol sequence for the whole image, shifted per pixel by an R2 dither mask
+};
+
+//hands out the sample dimensions of one (pixel, sample) path: pixel position, lens, time and a fixed budget per bounce,
+//so a dimension only depends on the pixel, the sample index and the bounce, never on what earlier bounces consumed
+class sampler{
+private:
+    samplerType type;
+    uint64_t seed;
+    uint32_t samplesPerPixel;
+
+    int pixelX = 0;
+    int pixelY = 0;
+    uint32_t sampleIndex = 0;
+    uint64_t pixelSeed = 0;
+    uint32_t dimension = 0;
+    int bounce = 0;
+    pcg32 rng;
+
+    static inline uint32_t reverseBits(uint32_t value){
+        value = (value << 16) | (value >> 16);
+        value = ((value & 0x00ff00ff) << 8) | ((value & 0xff00ff00) >> 8);
+        value = ((value & 0x0f0f0f0f) << 4) | ((value & 0xf0f0f0f0) >> 4);
+        value = ((value & 0x33333333) << 2) | ((value & 0xcccccccc) >> 2);
+        value = ((value & 0x55555555) << 1) | ((value & 0xaaaaaaaa) >> 1);
+        return value;
+    }
+
+    static inline float toUnitFloat(uint32_t value){
+        return (value >> 8) * (1.0f / 16777216.0f);
+    }
+
+    //first two sobol dimensions, the first one is the van der corput sequence
+    static inline uint32_t sobol0(uint32_t index){
+        return reverseBits(index);
+    }
+
+    static inline uint32_t sobol1(uint32_t index){
+        uint32_t result = 0;
+        for(uint32_t direction = 1u << 31; index; index >>= 1, direction ^= direction >> 1){
+            if(index & 1)
+                result ^= direction;
+        }
+        return result;
+    }
+
+    //Laine-Karras hash, equivalent to a random nested uniform (Owen) scramble when applied to bit reversed values
+    static inline uint32_t owenScramble(uint32_t value, uint32_t scrambleSeed){
+        value = reverseBits(value);
+        value += scrambleSeed;
+        value ^= value * 0x6c50b47cu;
+        value ^= value * 0xb82f1e52u;
+        value ^= value * 0xc7afe638u;
+        value ^= value * 0x8d22f6e6u;
+        return reverseBits(value);
+    }
+
+    //Kensler's hashed permutation of [0, length)
+    static uint32_t permute(uint32_t index, uint32_t length, uint32_t permutationSeed){
+        uint32_t mask = length - 1;
+        mask |= mask >> 1;
+        mask |= mask >> 2;
+        mask |= mask >> 4;
+        mask |= mask >> 8;
+        mask |= mask >> 16;
+
+        do{
+            index ^= permutationSeed;           index *= 0xe170893d;
+            index ^= permutationSeed >> 16;     index ^= (index & mask) >> 4;
+            index ^= permutationSeed >> 8;      index *= 0x0929eb3f;
+            index ^= permutationSeed >> 23;     index ^= (index & mask) >> 1;
+            index *= 1 | permutationSeed >> 27; index *= 0x6935fa69;
+            index ^= (index & mask) >> 11;      index *= 0x74dcb303;
+            index ^= (index & mask) >> 2;       index *= 0x9e501cc3;
+            index ^= (index & mask) >> 2;       index *= 0xc860a3df;
+            index &= mask;
+            index ^= index >> 5;
+        } while(index >= length);
+
+        return (index + permutationSeed) % length;
+    }
+
+    uint32_t dimensionSeed(uint32_t salt) const {
+        return static_cast<uint32_t>(mixSeed(pixelSeed ^ (static_cast<uint64_t>(dimension) << 32) ^ salt));
+    }
+
+    //R2 dither mask, neighbouring pixels get shifts that are far apart so the error spreads as blue noise
+    float ditherShift(uint32_t salt) const {
+        float offset = toUnitFloat(static_cast<uint32_t>(mixSeed(seed ^ (static_cast<uint64_t>(dimension) << 32) ^ salt)));
+        float shift = offset + pixelX * 0.7548776662f + pixelY * 0.5698402910f;
+        return shift - std::floor(shift);
+    }
+
+    float wrap(float value) const {
+        return value < 1.0f ? value : value - 1.0f;
+    }
+
+public:
+    //dimensions used by the camera ray: pixel position 2, lens 2, time 1
+    static const uint32_t cameraDimensions = 5;
+    //dimensions reserved for every bounce: light sampling 3, scatter functions at most 3, russian roulette 1
+    static const uint32_t bounceDimensions = 8;
+
+    sampler(samplerType type = samplerType::independent, uint64_t seed = 0, uint32_t samplesPerPixel = 1):
+        type{type},
+        seed{seed},
+        samplesPerPixel{std::max<uint32_t>(1, samplesPerPixel)}
+        {}
+
+    samplerType getType() const { return type; }
+
+    void startPixelSample(int x, int y, uint32_t sample){
+        pixelX = x;
+        pixelY = y;
+        sampleIndex = sample;
+        pixelSeed = type == samplerType::blueNoise ? mixSeed(seed) : mixSeed(seed ^ mixSeed((static_cast<uint64_t>(y) << 32) | static_cast<uint32_t>(x)));
+        startBounce(0);
+    }
+
+    //bounce 0 is the camera ray, bounce n the n-th scattered ray
+    void startBounce(int bounceIndex){
+        bounce = bounceIndex;
+        dimension = bounce == 0 ? 0 : cameraDimensions + (bounce - 1) * bounceDimensions;
+        rng.seed(sampleKey(seed, (static_cast<uint64_t>(pixelY) << 32) | static_cast<uint32_t>(pixelX), sampleIndex), bounce);
+    }
+
+    void nextBounce(){
+        startBounce(bounce + 1);
+    }
+
+    float get1D(){
+        float value;
+
+        switch(type){
+            case samplerType::stratified:{
+                if(sampleIndex >= samplesPerPixel){
+                    value = rng.nextFloat();
+                    break;
+                }
+                uint32_t permutationSeed = dimensionSeed(0);
+                uint32_t stratum = permute(sampleIndex, samplesPerPixel, permutationSeed);
+                value = (stratum + rng.nextFloat()) / samplesPerPixel;
+                break;
+            }
+            case samplerType::sobol:
+            case samplerType::blueNoise:{
+                uint32_t index = owenScramble(sampleIndex, dimensionSeed(0));
+                value = toUnitFloat(owenScramble(sobol0(index), dimensionSeed(1)));
+                if(type == samplerType::blueNoise)
+                    value = wrap(value + ditherShift(0));
+                break;
+            }
+            default:
+                value = rng.nextFloat();
+                break;
+        }
+
+        dimension++;
+        return value;
+    }
+
+    glm::vec2 get2D(){
+        glm::vec2 value;
+
+        switch(type){
+            case samplerType::stratified:{
+                if(sampleIndex >= samplesPerPixel){
+                    value = glm::vec2(rng.nextFloat(), rng.nextFloat());
+                    break;
+                }
+                //correlated multi-jittered sampling, stratified in 2D and in both 1D projections
+                uint32_t permutationSeed = dimensionSeed(0);
+                uint32_t columns = static_cast<uint32_t>(std::sqrt(static_cast<float>(samplesPerPixel)));
+                uint32_t rows = (samplesPerPixel + columns - 1) / columns;
+                uint32_t sample = permute(sampleIndex, samplesPerPixel, permutationSeed * 0x51633e2d);
+                uint32_t column = permute(sample % columns, columns, permutationSeed * 0x68bc21eb);
+                uint32_t row = permute(sample / columns, rows, permutationSeed * 0x02e5be93);
+                value.x = (column + (row + rng.nextFloat()) / rows) / columns;
+                value.y = (sample + rng.nextFloat()) / samplesPerPixel;
+                break;
+            }
+            case samplerType::sobol:
+            case samplerType::blueNoise:{
+                uint32_t index = owenScramble(sampleIndex, dimensionSeed(0));
+                value.x = toUnitFloat(owenScramble(sobol0(index), dimensionSeed(1)));
+                value.y = toUnitFloat(owenScramble(sobol1(index), dimensionSeed(2)));
+                if(type == samplerType::blueNoise){
+                    value.x = wrap(value.x + ditherShift(0));
+                    value.y = wrap(value.y + ditherShift(1));
+                }
+                break;
+            }
+            default:
+                value = glm::vec2(rng.nextFloat(), rng.nextFloat());
+                break;
+        }
+
+        dimension += 2;
+        return value;
+    }
+};
+
+//Shirley-Chiu concentric mapping of the unit square onto the unit disk, keeps the strata of the input intact
+inline glm::vec2 squareToConcentricDisk(const glm::vec2& sample){
+    glm::vec2 offset = 2.0f * sample - glm::vec2(1.0f);
+    if(offset.x == 0.0f && offset.y == 0.0f)
+        return glm::vec2(0.0f);
+
+    float radius, theta;
+    if(std::fabs(offset.x) > std::fabs(offset.y)){
+        radius = offset.x;
+        theta = static_cast<float>(pi / 4.0) * (offset.y / offset.x);
+    }
+    else{
+        radius = offset.y;
+        theta = static_cast<float>(pi / 2.0) - static_cast<float>(pi / 4.0) * (offset.x / offset.y);
+    }
+    return radius * glm::vec2(std::cos(theta), std::sin(theta));
+}
+
+inline glm::vec3 squareToUnitSphere(const glm::vec2& sample){
+    float z = 1.0f - 2.0f * sample.x;
+    float radius = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    float phi = static_cast<float>(2.0 * pi) * sample.y;
+    return glm::vec3(radius * std::cos(phi), radius * std::sin(phi), z);
+}
+
+//russian roulette on a path's throughput, survives with a probability proportional to its largest component and scales it
+//up by the inverse, returns false when the path ends. The cap keeps bright paths from surviving forever inside glass
+inline bool russianRoulette(color& throughput, sampler& samples){
+    float survival = std::min(0.95f, std::max(throughput.r, std::max(throughput.g, throughput.b)));
+    if(samples.get1D() >= survival)
+        return false;
+
+    throughput /= survival;
+    return true;
+}
+
+//direct replacements for the rejection sampled helpers in vec3.hpp
+inline glm::vec3 sampleUnitVector(sampler& samples){
+    return squareToUnitSphere(samples.get2D());
+}
+
+inline glm::vec3 sampleInUnitSphere(sampler& samples){
+    glm::vec3 direction = squareToUnitSphere(samples.get2D());
+    return std::cbrt(samples.get1D()) * direction;
+}
+
+inline glm::vec3 sampleInHemisphere(const glm::vec3& faceNormal, sampler& samples){
+    glm::vec3 inUnitSphere = sampleInUnitSphere(samples);
+    return glm::dot(inUnitSphere, faceNormal) < 0.0f ? -inUnitSphere : inUnitSphere;
+}
+
+#endif //SAMPLER_HPP
@@ -14,11 +14,13 @@ enum class scene {
     earth,
     spaceEarth,
     cornellBox,
-    instanceTest
+    instanceTest,
+    instanceGrid
 };
 
-hittableList randomScene() {
+hittableList randomScene(uint64_t seed = 0) {
     hittableList world;
+    pcg32 rng(seed);
 
     auto groundTexture = std::make_shared<checkerTexture>(color(0.15, 0.15, 0.15), color(0.95, 0.85, 0.85));
     world.add(std::make_shared<sphere>(point3(0,-1000,0), point3(0,-1000,0), 1000, 0.0, 1.0, std::make_shared<mat::lambertian>(groundTexture)));
@@ -26,22 +28,22 @@ hittableList randomScene() {
 
     for (int a = -12; a < 12; a++) {
         for (int b = -12; b < 12; b++) {
-            auto choose_mat = randomFloat(sharedRng);
-            point3 startCenter(a + 0.9*randomFloat(sharedRng), 0.2, b + 0.9*randomFloat(sharedRng));
-            point3 endCenter = startCenter + point3(0, randomFloat(sharedRng, 0, 0.), 0);
+            auto choose_mat = randomFloat(rng);
+            point3 startCenter(a + 0.9*randomFloat(rng), 0.2, b + 0.9*randomFloat(rng));
+            point3 endCenter = startCenter + point3(0, randomFloat(rng, 0, 0.), 0);
 
             if ((startCenter - point3(4, 0.2, 0)).length() > 0.9) {
                 std::shared_ptr<material> sphere_material;
 
                 if (choose_mat < 0.8) {
                     // diffuse
-                    color albedo = randomVec3() * randomVec3();
+                    color albedo = randomVec3(rng) * randomVec3(rng);
                     sphere_material = std::make_shared<mat::lambertian>(albedo);
                     world.add(std::make_shared<sphere>(startCenter, endCenter, 0.2, 0, 1.0, sphere_material));
                 } else if (choose_mat < 0.95) {
                     // metal
-                    color albedo = randomVec3(0.5, 1.0);
-                    auto fuzz = randomFloat(sharedRng, 0, 0.5);
+                    color albedo = randomVec3(rng, 0.5, 1.0);
+                    auto fuzz = randomFloat(rng, 0, 0.5);
                     sphere_material = std::make_shared<mat::metal>(albedo, fuzz);
                     world.add(std::make_shared<sphere>(startCenter, endCenter, 0.2, 0, 1.0, sphere_material));
                 } else {
@@ -58,9 +60,9 @@ hittableList randomScene() {
 
     for (int a = -12; a < 12; a++) {
         for (int b = -12; b < 12; b++) {
-            float size = randomFloat(sharedRng, 0.001, 0.03);
-            float height = 2 + randomFloat(sharedRng, -0.65, 0.65);
-            point3 startCenter(a + 0.9*randomFloat(sharedRng), height, b + 0.9*randomFloat(sharedRng));
+            float size = randomFloat(rng, 0.001, 0.03);
+            float height = 2 + randomFloat(rng, -0.65, 0.65);
+            point3 startCenter(a + 0.9*randomFloat(rng), height, b + 0.9*randomFloat(rng));
 
             if ((startCenter - point3(4, 2, 0)).length() > 2.5) {
                     world.add(std::make_shared<sphere>(startCenter, size, sunMaterial));
@@ -183,6 +185,38 @@ hittableList instanceTest(){
     return world;
 }
 
+//a group of 65 objects placed 4096 times, with accelerationStructure::twoLevel all copies share one bottom level bvh
+hittableList instanceGrid(){
+    hittableList world;
+    pcg32 rng(7);
+
+    auto groundMaterial = std::make_shared<mat::lambertian>(std::make_shared<checkerTexture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9)));
+    world.add(std::make_shared<sphere>(point3(0,-1000,0), point3(0,-1000,0), 1000, 0.0, 1.0, groundMaterial));
+
+    //a pedestal with a spiral of 64 small spheres around it
+    std::shared_ptr<hittableList> group = std::make_shared<hittableList>();
+    group->add(std::make_shared<box>(point3(-0.15, 0, -0.15), point3(0.15, 0.6, 0.15), std::make_shared<mat::lambertian>(color(0.7, 0.3, 0.2))));
+    auto spiralMaterial = std::make_shared<mat::metal>(color(0.8, 0.8, 0.9), 0.1);
+    for(int i = 0; i < 64; i++){
+        float angle = 0.5f * i;
+        group->add(std::make_shared<sphere>(point3(0.4f * std::cos(angle), 0.05f + 0.012f * i, 0.4f * std::sin(angle)), 0.05, spiralMaterial));
+    }
+
+    for(int a = -32; a < 32; a++){
+        for(int b = -32; b < 32; b++){
+            glm::mat4 placement = glm::translate(glm::vec3(1.5f * a + 0.5f * randomFloat(rng), 0, 1.5f * b + 0.5f * randomFloat(rng))) *
+                                  glm::rotate(randomFloat(rng, 0, 2 * pi), glm::vec3(0,1,0)) *
+                                  glm::scale(glm::vec3(randomFloat(rng, 0.6, 1.4)));
+            world.add(std::make_shared<instance>(group, placement));
+        }
+    }
+
+    std::shared_ptr<mat::diffuseLight> light = std::make_shared<mat::diffuseLight>(color(1.0, 0.9, 0.8), 8.0);
+    world.add(std::make_shared<sphere>(point3(-10, 30, -20), 8.0, light));
+
+    return world;
+}
+
 void setScene(scene sceneSelection, hittableList& world, point3& cameraPosition, point3& cameraTarget, point3& cameraUp, float& vFov, color& backgroundColor){
     switch(sceneSelection){
         case scene::randomBalls:
@@ -243,6 +277,15 @@ void setScene(scene sceneSelection, hittableList& world, point3& cameraPosition,
             backgroundColor = color(0.5,0.5,0.5);
             break;
 
+        case scene::instanceGrid:
+            world = instanceGrid();
+            cameraPosition = point3(20, 6, 14);
+            cameraTarget = point3(0, 0, 0);
+            cameraUp = point3(0,1,0);
+            vFov = 30.0;
+            backgroundColor = color(0.35, 0.40, 0.50);
+            break;
+
         default:
             break;
     }
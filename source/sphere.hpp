@@ -2,11 +2,15 @@
 #define SPHERE_HPP
 
 #include "hittable.hpp"
+#include "material.hpp"
 #include "vec3.hpp"
 #include <cmath>
 
 class sphere : public hittable{
 private:
+    friend class compiledScene;
+    friend class sphereGroup;
+
     glm::vec3 startCenter;
     glm::vec3 endCenter;
     float startTime;
@@ -30,6 +34,18 @@ private:
         v = acos(-hitPoint.y) / pi;
     }
 
+    bool intersectDistance(const ray& r, float distMin, float distMax, float& hitDistance) const;
+
+    void setHitRecord(const ray& r, float hitDistance, hitRecord& record) const {
+        record.distance = hitDistance;
+        record.hitLocation = r.at(hitDistance);
+        glm::vec3 outwardNormal = (record.hitLocation - center(r.hitTime())) / radius;
+        record.setFaceNormal(r, outwardNormal);
+        record.materialPointer = materialPointer;
+        record.objectId = objectId;
+        getSphereUV(outwardNormal, record.u, record.v);
+    }
+
 public:
     // sphere(){}
     
@@ -52,10 +68,70 @@ public:
         {}
 
     virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override;
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override;
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refBox) const override;
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        float hitDistance;
+        return intersectDistance(r, distMin, distMax, hitDistance);
+    }
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override;
+
+    virtual bool emitsLight() const override {
+        return materialPointer && materialPointer->isEmissive();
+    }
+
+    //1 - cos of the half angle of the cone the sphere covers from centerDistanceSquared away, written so it does not cancel
+    //to 0 for small or distant spheres
+    float coneOneMinusCos(float centerDistanceSquared) const {
+        float sinSquared = radius * radius / centerDistanceSquared;
+        return sinSquared / (1.0f + std::sqrt(1.0f - sinSquared));
+    }
+
+    //directions are picked uniformly inside the cone the sphere covers as seen from origin
+    virtual float pdfValue(const point3& origin, const glm::vec3& direction, float time) const override {
+        float hitDistance;
+        if(!intersectDistance(ray(origin, direction, time), 0.001f, infinity, hitDistance))
+            return 0.0f;
+
+        float centerDistanceSquared = lengthSquared(center(time) - origin);
+        if(centerDistanceSquared <= radius * radius)
+            return 0.0f;
+
+        return 1.0f / (static_cast<float>(2.0 * pi) * coneOneMinusCos(centerDistanceSquared));
+    }
+
+    virtual glm::vec3 sampleDirection(const point3& origin, const glm::vec2& sample, float time) const override {
+        glm::vec3 toCenter = center(time) - origin;
+        float centerDistanceSquared = lengthSquared(toCenter);
+        if(centerDistanceSquared <= radius * radius)
+            return toCenter;
+
+        float cosTheta = 1.0f - sample.y * coneOneMinusCos(centerDistanceSquared);
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = static_cast<float>(2.0 * pi) * sample.x;
+
+        //orthonormal basis around the direction to the center
+        glm::vec3 w = toCenter / std::sqrt(centerDistanceSquared);
+        glm::vec3 helper = std::fabs(w.x) > 0.9f ? glm::vec3(0,1,0) : glm::vec3(1,0,0);
+        glm::vec3 u = glm::normalize(glm::cross(helper, w));
+        glm::vec3 v = glm::cross(w, u);
+
+        return std::cos(phi) * sinTheta * u + std::sin(phi) * sinTheta * v + cosTheta * w;
+    }
+
+    //the surface emits in every direction, each point over its hemisphere
+    virtual bool getLightBounds(float tStart, float tEnd, lightBounds& bounds) const override {
+        axisAlignedBoundingBox box;
+        boundingBox(tStart, tEnd, box);
+        float area = static_cast<float>(4.0 * pi) * radius * radius;
+        bounds = lightBounds(box, glm::vec3(0,0,1), luminance(materialPointer->averageEmission()) * area, -1.0f, 0.0f, false);
+        return !bounds.empty();
+    }
 };
 
-bool sphere::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
+inline bool sphere::intersectDistance(const ray& r, float distMin, float distMax, float& hitDistance) const {
     glm::vec3 originMinCenter = r.origin() - center(r.hitTime());
     glm::vec3 rayDirection = r.direction();
     float a = lengthSquared(rayDirection);
@@ -67,7 +143,7 @@ bool sphere::hit(const ray& r, float distMin, float distMax, hitRecord& record)
         return false;
 
     float sqrtDiscriminant = std::sqrt(discriminant);
-    float hitDistance = (-bHalf - sqrtDiscriminant) / a;
+    hitDistance = (-bHalf - sqrtDiscriminant) / a;
     //TODO: check if performance increases when you remove the extra branch
     if(hitDistance < distMin || hitDistance > distMax){
         hitDistance = (-bHalf + sqrtDiscriminant) / a;
@@ -75,16 +151,93 @@ bool sphere::hit(const ray& r, float distMin, float distMax, hitRecord& record)
             return false;
     }
 
-    record.distance = hitDistance;
-    record.hitLocation = r.at(hitDistance);
-    glm::vec3 outwardNormal = (record.hitLocation - center(r.hitTime())) / radius;
-    record.setFaceNormal(r, outwardNormal);
-    record.materialPointer = materialPointer;
-    getSphereUV(outwardNormal, record.u, record.v);
+    return true;
+}
+
+bool sphere::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
+    float hitDistance;
+    if(!intersectDistance(r, distMin, distMax, hitDistance))
+        return false;
+
+    setHitRecord(r, hitDistance, record);
+    return true;
+}
+
+bool sphere::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
+    float hitDistance;
+    if(!intersectDistance(r, distMin, distMax, hitDistance))
+        return false;
 
+    query.claim(this, hitDistance);
     return true;
 }
 
+void sphere::finalize(const ray& r, const hitQuery& query, hitRecord& record) const {
+    setHitRecord(r, query.distance, record);
+}
+
+//same quadratic as hit() for 4 lanes at a time, hit records are only filled in for the lanes that hit
+int sphere::hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const {
+#ifdef RAY_PACKET_SSE
+    alignas(16) float distances[rayPacket::width];
+    int hitMask = 0;
+
+    const __m128 startTimeWide = _mm_set1_ps(startTime);
+    const __m128 inverseDuration = _mm_set1_ps(1.0f / (endTime - startTime));
+    const __m128 radiusSquared = _mm_set1_ps(radius * radius);
+    const __m128 distMinWide = _mm_set1_ps(distMin);
+    const __m128 zero = _mm_setzero_ps();
+
+    for(int half = 0; half < rayPacket::width; half += 4){
+        if(!((activeMask >> half) & 0xF))
+            continue;
+
+        __m128 factor = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(packet.time + half), startTimeWide), inverseDuration);
+        __m128 centerX = _mm_add_ps(_mm_set1_ps(startCenter.x), _mm_mul_ps(factor, _mm_set1_ps(endCenter.x - startCenter.x)));
+        __m128 centerY = _mm_add_ps(_mm_set1_ps(startCenter.y), _mm_mul_ps(factor, _mm_set1_ps(endCenter.y - startCenter.y)));
+        __m128 centerZ = _mm_add_ps(_mm_set1_ps(startCenter.z), _mm_mul_ps(factor, _mm_set1_ps(endCenter.z - startCenter.z)));
+
+        __m128 ocX = _mm_sub_ps(_mm_loadu_ps(packet.originX + half), centerX);
+        __m128 ocY = _mm_sub_ps(_mm_loadu_ps(packet.originY + half), centerY);
+        __m128 ocZ = _mm_sub_ps(_mm_loadu_ps(packet.originZ + half), centerZ);
+        __m128 dX = _mm_loadu_ps(packet.directionX + half);
+        __m128 dY = _mm_loadu_ps(packet.directionY + half);
+        __m128 dZ = _mm_loadu_ps(packet.directionZ + half);
+
+        __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dX, dX), _mm_mul_ps(dY, dY)), _mm_mul_ps(dZ, dZ));
+        __m128 bHalf = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dX, ocX), _mm_mul_ps(dY, ocY)), _mm_mul_ps(dZ, ocZ));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), radiusSquared);
+        __m128 discriminant = _mm_sub_ps(_mm_mul_ps(bHalf, bHalf), _mm_mul_ps(a, c));
+
+        __m128 valid = _mm_cmpge_ps(discriminant, zero);
+        __m128 sqrtDiscriminant = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        __m128 inverseA = _mm_div_ps(_mm_set1_ps(1.0f), a);
+        __m128 nearDistance = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+        __m128 farDistance = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+
+        __m128 distMaxWide = _mm_loadu_ps(distMax + half);
+        __m128 nearInRange = _mm_and_ps(_mm_cmpge_ps(nearDistance, distMinWide), _mm_cmple_ps(nearDistance, distMaxWide));
+        __m128 farInRange = _mm_and_ps(_mm_cmpge_ps(farDistance, distMinWide), _mm_cmple_ps(farDistance, distMaxWide));
+
+        __m128 hitDistance = _mm_or_ps(_mm_and_ps(nearInRange, nearDistance), _mm_andnot_ps(nearInRange, farDistance));
+        _mm_store_ps(distances + half, hitDistance);
+        hitMask |= _mm_movemask_ps(_mm_and_ps(valid, _mm_or_ps(nearInRange, farInRange))) << half;
+    }
+
+    hitMask &= activeMask;
+    for(int lane = 0; lane < rayPacket::width; lane++){
+        if(hitMask & (1 << lane)){
+            setHitRecord(packet.rays[lane], distances[lane], records[lane]);
+            distMax[lane] = distances[lane];
+        }
+    }
+
+    return hitMask;
+#else
+    return hittable::hitPacket(packet, activeMask, distMin, distMax, records);
+#endif
+}
+
 bool sphere::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
     axisAlignedBoundingBox tStartBox = axisAlignedBoundingBox(center(tStart) - glm::vec3(radius, radius, radius), center(tStart) + glm::vec3(radius, radius, radius));
     axisAlignedBoundingBox tEndBox   = axisAlignedBoundingBox(center(tEnd) - glm::vec3(radius, radius, radius), center(tEnd) + glm::vec3(radius, radius, radius));
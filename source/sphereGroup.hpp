@@ -0,0 +1,286 @@
+#ifndef SPHERE_GROUP_HPP
+#define SPHERE_GROUP_HPP
+
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "sphere.hpp"
+
+#if defined(__AVX__)
+    #define SPHERE_GROUP_AVX
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define SPHERE_GROUP_SSE
+    #include <emmintrin.h>
+#endif
+
+//up to a few dozen spheres intersected against one ray with a SIMD kernel, 8 per step with AVX and 4 with SSE.
+//Only distances are compared inside the group, the normal, uv and material are filled in once for the closest sphere
+class sphereGroup : public hittable {
+private:
+    static const int simdWidth = 8;
+
+    std::vector<float> centerX, centerY, centerZ;          //center at time 0, padded to a multiple of simdWidth
+    std::vector<float> velocityX, velocityY, velocityZ;    //center movement per unit of time
+    std::vector<float> radiusSquared;
+    std::vector<std::shared_ptr<sphere>> members;
+    axisAlignedBoundingBox groupBoundingBox;
+
+    bool closestHit(const ray& r, float distMin, float distMax, float& hitDistance, int& hitIndex) const;
+
+public:
+    sphereGroup(){}
+
+    sphereGroup(const std::vector<std::shared_ptr<sphere>>& spheres, float tStart = 0.0, float tEnd = 1.0);
+
+    virtual bool hit(const ray& r, float distMin, float distMax, hitRecord& record) const override;
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override;
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override;
+    virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override;
+
+    //the kernel tests all members at once anyway, so the closest hit costs the same as any hit
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        float hitDistance;
+        int hitIndex;
+        return closestHit(r, distMin, distMax, hitDistance, hitIndex);
+    }
+
+    int size() const { return static_cast<int>(members.size()); }
+};
+
+sphereGroup::sphereGroup(const std::vector<std::shared_ptr<sphere>>& spheres, float tStart, float tEnd):
+    members{spheres}
+{
+    for(size_t i = 0; i < members.size(); i++){
+        const sphere& member = *members[i];
+        glm::vec3 velocity = (member.endCenter - member.startCenter) / (member.endTime - member.startTime);
+        glm::vec3 centerAtZero = member.startCenter - member.startTime * velocity;
+
+        centerX.push_back(centerAtZero.x);
+        centerY.push_back(centerAtZero.y);
+        centerZ.push_back(centerAtZero.z);
+        velocityX.push_back(velocity.x);
+        velocityY.push_back(velocity.y);
+        velocityZ.push_back(velocity.z);
+        radiusSquared.push_back(member.radius * member.radius);
+
+        axisAlignedBoundingBox memberBox;
+        member.boundingBox(tStart, tEnd, memberBox);
+        groupBoundingBox = i == 0 ? memberBox : surroundingBox(groupBoundingBox, memberBox);
+    }
+
+    //padding lanes get a negative squared radius so their discriminant is always negative
+    size_t paddedSize = (members.size() + simdWidth - 1) / simdWidth * simdWidth;
+    for(std::vector<float>* channel : { &centerX, &centerY, &centerZ, &velocityX, &velocityY, &velocityZ }){
+        channel->resize(paddedSize, 0.0f);
+    }
+    radiusSquared.resize(paddedSize, -1.0f);
+}
+
+//same quadratic as sphere::hit for every member, returns the index of the closest one
+inline bool sphereGroup::closestHit(const ray& r, float distMin, float distMax, float& hitDistance, int& hitIndex) const {
+    const glm::vec3 origin = r.origin();
+    const glm::vec3 direction = r.direction();
+    const float time = r.hitTime();
+    const float a = lengthSquared(direction);
+    const int paddedSize = static_cast<int>(radiusSquared.size());
+    bool hitAnything = false;
+
+#if defined(SPHERE_GROUP_AVX)
+    const int step = 8;
+    const __m256 timeWide = _mm256_set1_ps(time);
+    const __m256 originX = _mm256_set1_ps(origin.x), originY = _mm256_set1_ps(origin.y), originZ = _mm256_set1_ps(origin.z);
+    const __m256 directionX = _mm256_set1_ps(direction.x), directionY = _mm256_set1_ps(direction.y), directionZ = _mm256_set1_ps(direction.z);
+    const __m256 inverseA = _mm256_set1_ps(1.0f / a);
+    const __m256 distMinWide = _mm256_set1_ps(distMin);
+    const __m256 zero = _mm256_setzero_ps();
+#elif defined(SPHERE_GROUP_SSE)
+    const int step = 4;
+    const __m128 timeWide = _mm_set1_ps(time);
+    const __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+    const __m128 directionX = _mm_set1_ps(direction.x), directionY = _mm_set1_ps(direction.y), directionZ = _mm_set1_ps(direction.z);
+    const __m128 inverseA = _mm_set1_ps(1.0f / a);
+    const __m128 distMinWide = _mm_set1_ps(distMin);
+    const __m128 zero = _mm_setzero_ps();
+#else
+    const int step = 1;
+#endif
+
+    for(int i = 0; i < paddedSize; i += step){
+        float distances[simdWidth];
+        int hitMask;
+
+#if defined(SPHERE_GROUP_AVX)
+        __m256 ocX = _mm256_sub_ps(originX, _mm256_add_ps(_mm256_loadu_ps(&centerX[i]), _mm256_mul_ps(_mm256_loadu_ps(&velocityX[i]), timeWide)));
+        __m256 ocY = _mm256_sub_ps(originY, _mm256_add_ps(_mm256_loadu_ps(&centerY[i]), _mm256_mul_ps(_mm256_loadu_ps(&velocityY[i]), timeWide)));
+        __m256 ocZ = _mm256_sub_ps(originZ, _mm256_add_ps(_mm256_loadu_ps(&centerZ[i]), _mm256_mul_ps(_mm256_loadu_ps(&velocityZ[i]), timeWide)));
+
+        __m256 bHalf = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(directionX, ocX), _mm256_mul_ps(directionY, ocY)), _mm256_mul_ps(directionZ, ocZ));
+        __m256 c = _mm256_sub_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ocX, ocX), _mm256_mul_ps(ocY, ocY)), _mm256_mul_ps(ocZ, ocZ)), _mm256_loadu_ps(&radiusSquared[i]));
+        __m256 discriminant = _mm256_sub_ps(_mm256_mul_ps(bHalf, bHalf), _mm256_mul_ps(_mm256_set1_ps(a), c));
+        __m256 valid = _mm256_cmp_ps(discriminant, zero, _CMP_GE_OQ);
+        if(_mm256_movemask_ps(valid) == 0)
+            continue;
+
+        __m256 sqrtDiscriminant = _mm256_sqrt_ps(_mm256_max_ps(discriminant, zero));
+        __m256 nearDistance = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+        __m256 farDistance = _mm256_mul_ps(_mm256_add_ps(_mm256_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+
+        __m256 distMaxWide = _mm256_set1_ps(distMax);
+        __m256 nearInRange = _mm256_and_ps(_mm256_cmp_ps(nearDistance, distMinWide, _CMP_GE_OQ), _mm256_cmp_ps(nearDistance, distMaxWide, _CMP_LE_OQ));
+        __m256 farInRange = _mm256_and_ps(_mm256_cmp_ps(farDistance, distMinWide, _CMP_GE_OQ), _mm256_cmp_ps(farDistance, distMaxWide, _CMP_LE_OQ));
+
+        _mm256_storeu_ps(distances, _mm256_blendv_ps(farDistance, nearDistance, nearInRange));
+        hitMask = _mm256_movemask_ps(_mm256_and_ps(valid, _mm256_or_ps(nearInRange, farInRange)));
+#elif defined(SPHERE_GROUP_SSE)
+        __m128 ocX = _mm_sub_ps(originX, _mm_add_ps(_mm_loadu_ps(&centerX[i]), _mm_mul_ps(_mm_loadu_ps(&velocityX[i]), timeWide)));
+        __m128 ocY = _mm_sub_ps(originY, _mm_add_ps(_mm_loadu_ps(&centerY[i]), _mm_mul_ps(_mm_loadu_ps(&velocityY[i]), timeWide)));
+        __m128 ocZ = _mm_sub_ps(originZ, _mm_add_ps(_mm_loadu_ps(&centerZ[i]), _mm_mul_ps(_mm_loadu_ps(&velocityZ[i]), timeWide)));
+
+        __m128 bHalf = _mm_add_ps(_mm_add_ps(_mm_mul_ps(directionX, ocX), _mm_mul_ps(directionY, ocY)), _mm_mul_ps(directionZ, ocZ));
+        __m128 c = _mm_sub_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ocX, ocX), _mm_mul_ps(ocY, ocY)), _mm_mul_ps(ocZ, ocZ)), _mm_loadu_ps(&radiusSquared[i]));
+        __m128 discriminant = _mm_sub_ps(_mm_mul_ps(bHalf, bHalf), _mm_mul_ps(_mm_set1_ps(a), c));
+        __m128 valid = _mm_cmpge_ps(discriminant, zero);
+        if(_mm_movemask_ps(valid) == 0)
+            continue;
+
+        __m128 sqrtDiscriminant = _mm_sqrt_ps(_mm_max_ps(discriminant, zero));
+        __m128 nearDistance = _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+        __m128 farDistance = _mm_mul_ps(_mm_add_ps(_mm_sub_ps(zero, bHalf), sqrtDiscriminant), inverseA);
+
+        __m128 distMaxWide = _mm_set1_ps(distMax);
+        __m128 nearInRange = _mm_and_ps(_mm_cmpge_ps(nearDistance, distMinWide), _mm_cmple_ps(nearDistance, distMaxWide));
+        __m128 farInRange = _mm_and_ps(_mm_cmpge_ps(farDistance, distMinWide), _mm_cmple_ps(farDistance, distMaxWide));
+
+        _mm_storeu_ps(distances, _mm_or_ps(_mm_and_ps(nearInRange, nearDistance), _mm_andnot_ps(nearInRange, farDistance)));
+        hitMask = _mm_movemask_ps(_mm_and_ps(valid, _mm_or_ps(nearInRange, farInRange)));
+#else
+        glm::vec3 originMinCenter = origin - glm::vec3(centerX[i] + velocityX[i] * time, centerY[i] + velocityY[i] * time, centerZ[i] + velocityZ[i] * time);
+        float bHalf = dot(direction, originMinCenter);
+        float c = lengthSquared(originMinCenter) - radiusSquared[i];
+        float discriminant = bHalf*bHalf - a*c;
+        if(discriminant < 0.0)
+            continue;
+
+        float sqrtDiscriminant = std::sqrt(discriminant);
+        distances[0] = (-bHalf - sqrtDiscriminant) / a;
+        if(distances[0] < distMin || distances[0] > distMax)
+            distances[0] = (-bHalf + sqrtDiscriminant) / a;
+        hitMask = (distances[0] >= distMin && distances[0] <= distMax) ? 1 : 0;
+#endif
+
+        for(; hitMask; hitMask &= hitMask - 1){
+            int lane = 0;
+            while(!(hitMask & (1 << lane))) lane++;
+
+            if(distances[lane] <= distMax){
+                distMax = distances[lane];
+                hitDistance = distances[lane];
+                hitIndex = i + lane;
+                hitAnything = true;
+            }
+        }
+    }
+
+    return hitAnything;
+}
+
+bool sphereGroup::hit(const ray& r, float distMin, float distMax, hitRecord& record) const {
+    float hitDistance;
+    int hitIndex;
+    if(!closestHit(r, distMin, distMax, hitDistance, hitIndex))
+        return false;
+
+    members[hitIndex]->setHitRecord(r, hitDistance, record);
+    return true;
+}
+
+bool sphereGroup::intersect(const ray& r, float distMin, float distMax, hitQuery& query) const {
+    float hitDistance;
+    int hitIndex;
+    if(!closestHit(r, distMin, distMax, hitDistance, hitIndex))
+        return false;
+
+    query.claim(this, hitDistance, static_cast<uint32_t>(hitIndex));
+    return true;
+}
+
+void sphereGroup::finalize(const ray& r, const hitQuery& query, hitRecord& record) const {
+    members[query.primitiveId]->setHitRecord(r, query.distance, record);
+}
+
+bool sphereGroup::boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const {
+    if(members.empty())
+        return false;
+
+    refbox = groupBoundingBox;
+    return true;
+}
+
+//packs the spheres of a list into groups of neighbouring spheres along a morton curve, everything else is passed through.
+//Spheres much larger than the average stay on their own so they don't inflate the group boxes
+hittableList groupSpheres(const hittableList& list, int groupSize = 8, float tStart = 0.0, float tEnd = 1.0){
+    hittableList grouped;
+    std::vector<std::shared_ptr<sphere>> candidates;
+    std::vector<axisAlignedBoundingBox> candidateBoxes;
+
+    for(const std::shared_ptr<hittable>& object : list.objectList()){
+        std::shared_ptr<sphere> sphereObject = std::dynamic_pointer_cast<sphere>(object);
+        if(!sphereObject){
+            grouped.add(object);
+            continue;
+        }
+
+        axisAlignedBoundingBox sphereBox;
+        sphereObject->boundingBox(tStart, tEnd, sphereBox);
+        candidates.push_back(sphereObject);
+        candidateBoxes.push_back(sphereBox);
+    }
+
+    if(candidates.size() < 2){
+        for(const std::shared_ptr<sphere>& sphereObject : candidates){
+            grouped.add(sphereObject);
+        }
+        return grouped;
+    }
+
+    float averageArea = 0.0f;
+    axisAlignedBoundingBox centroidBox(candidateBoxes[0].centroid(), candidateBoxes[0].centroid());
+    for(const axisAlignedBoundingBox& sphereBox : candidateBoxes){
+        averageArea += sphereBox.surfaceArea() / candidateBoxes.size();
+        centroidBox = surroundingBox(centroidBox, sphereBox.centroid());
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> mortonOrder;
+    const glm::vec3 cellScale = 1023.0f / glm::max(centroidBox.extent(), glm::vec3(1e-6f));
+    for(uint32_t i = 0; i < candidates.size(); i++){
+        if(candidateBoxes[i].surfaceArea() > 16.0f * averageArea){
+            grouped.add(candidates[i]);
+            continue;
+        }
+
+        glm::vec3 cell = (candidateBoxes[i].centroid() - centroidBox.cornerClosest()) * cellScale;
+        uint32_t morton = 0;
+        for(int bit = 9; bit >= 0; bit--){
+            for(int dimension = 0; dimension < 3; dimension++){
+                morton = (morton << 1) | ((static_cast<uint32_t>(cell[dimension]) >> bit) & 1);
+            }
+        }
+        mortonOrder.push_back({ morton, i });
+    }
+
+    std::sort(mortonOrder.begin(), mortonOrder.end());
+
+    for(size_t start = 0; start < mortonOrder.size(); start += groupSize){
+        std::vector<std::shared_ptr<sphere>> members;
+        for(size_t i = start; i < std::min(mortonOrder.size(), start + groupSize); i++){
+            members.push_back(candidates[mortonOrder[i].second]);
+        }
+        grouped.add(std::make_shared<sphereGroup>(members, tStart, tEnd));
+    }
+
+    return grouped;
+}
+
+#endif //SPHERE_GROUP_HPP
@@ -9,6 +9,9 @@
 class texture{
 public:
     virtual color value(float u, float v, const glm::vec3& point) const = 0;
+
+    //rough mean over the surface, used to estimate the power of emitters
+    virtual color averageValue() const { return value(0.5f, 0.5f, glm::vec3(0,0,0)); }
 };
 
 class solidColorTexture : public texture{
@@ -29,6 +32,10 @@ public:
     virtual color value(float u, float v, const glm::vec3& point) const override {
         return colorValue;
     }
+
+    virtual color averageValue() const override {
+        return colorValue;
+    }
 };
 
 class checkerTexture : public texture{
@@ -52,6 +59,10 @@ public:
         float sineSum = sin(point.x * 10) * sin(point.y * 10) * sin(point.z * 10);
         return sineSum < 0 ? odd->value(u, v, point) : even->value(u, v, point);
     }
+
+    virtual color averageValue() const override {
+        return 0.5f * (even->averageValue() + odd->averageValue());
+    }
 };
 
 class perlinTexture : public texture{
@@ -75,6 +86,7 @@ private:
     int width;
     int height;
     int bytesPerPixel;
+    color average = color(1,0,1);
 public:
     imageTexture():
         imageData{nullptr},
@@ -90,7 +102,15 @@ public:
             std::cerr << "ERROR: failed to load image at " << imagePath << ".\n" << std::flush;
             width = 0;
             height = 0;
+            return;
+        }
+
+        //stbi was asked for 3 channels
+        glm::dvec3 sum(0.0);
+        for(size_t i = 0; i < static_cast<size_t>(width) * height; i++){
+            sum += glm::dvec3(imageData[3 * i], imageData[3 * i + 1], imageData[3 * i + 2]);
         }
+        average = color(sum / (255.0 * width * height));
     }
 
     ~imageTexture(){
@@ -117,6 +137,10 @@ public:
 
         return color(r, g, b);
     }
+
+    virtual color averageValue() const override {
+        return average;
+    }
 };
 
 #endif //TEXTURES_HPP
\ No newline at end of file
@@ -0,0 +1,174 @@
+#ifndef TILE_SCHEDULER_HPP
+#define TILE_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include "rtweekend.hpp"
+#include "hittableList.hpp"
+#include "camera.hpp"
+#include "sampler.hpp"
+#include "framebuffer.hpp"
+#include "aov.hpp"
+#include "lights.hpp"
+
+//pixel rectangle [x0, x1) x [row0, row1), rows counted from the top of the image
+struct imageTile{
+    int x0, row0;
+    int x1, row1;
+
+    int width() const { return x1 - x0; }
+    int height() const { return row1 - row0; }
+};
+
+enum class tileOrder{
+    scanline,
+    spiral,     //from the image center outwards, the interesting part of most scenes shows up first
+    hilbert     //neighbouring tiles are rendered after each other, keeps the bvh nodes of one area in cache
+};
+
+struct renderSettings{
+    int image_width = 0;
+    int image_height = 0;
+    int pixelSampleCount = 1;   //samples rendered per pixel by one call of a renderFunction
+    int sampleStart = 0;        //index of the first of them, later passes continue the sample sequence of earlier ones
+    int sampleBudget = 0;       //samples per pixel the sampler stratifies over, when a pixel gets more than one pass
+    int maxDepth = 10;
+    int russianRouletteDepth = 3;   //bounces every path gets before russian roulette may end it
+    color backgroundColor = color(0,0,0);
+    uint64_t seed = 0;
+    samplerType sampling = samplerType::independent;
+    const lightList* lights = nullptr;  //emitters for next event estimation, without them light is only found by scattered rays
+
+    int samplerSampleCount() const { return std::max(sampleBudget, sampleStart + pixelSampleCount); }
+};
+
+//renders every pixel of a tile with all its samples into the framebuffer, the aovs of the camera rays' first hits go to aovs unless it is null
+typedef void (*renderFunction)(const imageTile&, const renderSettings&, framebuffer&, aovBuffers*, const camera&, const hittableList&);
+
+//index of cell (x, y) along the hilbert curve through a size x size grid, size is a power of two
+inline uint32_t hilbertIndex(uint32_t size, uint32_t x, uint32_t y){
+    uint32_t index = 0;
+    for(uint32_t s = size / 2; s > 0; s /= 2){
+        uint32_t rx = (x & s) > 0 ? 1 : 0;
+        uint32_t ry = (y & s) > 0 ? 1 : 0;
+        index += s * s * ((3 * rx) ^ ry);
+
+        if(ry == 0){
+            if(rx == 1){
+                x = size - 1 - x;
+                y = size - 1 - y;
+            }
+            std::swap(x, y);
+        }
+    }
+    return index;
+}
+
+std::vector<imageTile> makeTiles(int image_width, int image_height, int tileSize, tileOrder order){
+    tileSize = std::max(1, tileSize);
+    const int columns = (image_width + tileSize - 1) / tileSize;
+    const int rows = (image_height + tileSize - 1) / tileSize;
+
+    std::vector<std::pair<uint64_t, imageTile>> keyedTiles;
+    keyedTiles.reserve(static_cast<size_t>(columns) * rows);
+
+    uint32_t hilbertSize = 1;
+    while(hilbertSize < static_cast<uint32_t>(std::max(columns, rows)))
+        hilbertSize *= 2;
+
+    for(int row = 0; row < rows; row++){
+        for(int column = 0; column < columns; column++){
+            imageTile tile{ column * tileSize, row * tileSize, std::min(image_width, (column + 1) * tileSize), std::min(image_height, (row + 1) * tileSize) };
+            uint64_t key = static_cast<uint64_t>(row) * columns + column;
+
+            if(order == tileOrder::hilbert){
+                key = hilbertIndex(hilbertSize, column, row);
+            }
+            else if(order == tileOrder::spiral){
+                //ring around the center first, then the angle inside the ring
+                float dx = column - (columns - 1) * 0.5f;
+                float dy = row - (rows - 1) * 0.5f;
+                uint64_t ring = static_cast<uint64_t>(std::max(std::fabs(dx), std::fabs(dy)) * 2.0f);
+                uint64_t angle = static_cast<uint64_t>((std::atan2(dy, dx) + pi) * 1000.0);
+                key = (ring << 32) | angle;
+            }
+
+            keyedTiles.push_back({ key, tile });
+        }
+    }
+
+    std::stable_sort(keyedTiles.begin(), keyedTiles.end(), [](const std::pair<uint64_t, imageTile>& a, const std::pair<uint64_t, imageTile>& b){ return a.first < b.first; });
+
+    std::vector<imageTile> tiles;
+    tiles.reserve(keyedTiles.size());
+    for(const std::pair<uint64_t, imageTile>& keyedTile : keyedTiles){
+        tiles.push_back(keyedTile.second);
+    }
+    return tiles;
+}
+
+//every worker owns a deque of tiles dealt out round robin in tile order, it takes its own tiles from the front
+//and steals from the back of the other workers' deques once it runs dry, so expensive tiles do not stall the render
+class tileScheduler{
+private:
+    struct workerQueue{
+        std::mutex mutex;
+        std::deque<imageTile> tiles;
+    };
+
+    std::vector<std::unique_ptr<workerQueue>> queues;
+
+public:
+    tileScheduler(const std::vector<imageTile>& tiles, int workerCount){
+        workerCount = std::max(1, workerCount);
+        for(int i = 0; i < workerCount; i++){
+            queues.push_back(std::make_unique<workerQueue>());
+        }
+        for(size_t i = 0; i < tiles.size(); i++){
+            queues[i % workerCount]->tiles.push_back(tiles[i]);
+        }
+    }
+
+    bool next(int worker, imageTile& tile){
+        {
+            workerQueue& own = *queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if(!own.tiles.empty()){
+                tile = own.tiles.front();
+                own.tiles.pop_front();
+                return true;
+            }
+        }
+
+        for(size_t offset = 1; offset < queues.size(); offset++){
+            workerQueue& victim = *queues[(worker + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if(!victim.tiles.empty()){
+                tile = victim.tiles.back();
+                victim.tiles.pop_back();
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+//runs renderTile for every tile on threadCount workers, the calling thread is worker 0
+inline void renderTiles(const std::vector<imageTile>& tiles, int threadCount, const std::function<void(const imageTile& tile, int worker)>& renderTile){
+    threadCount = std::max(1, threadCount);
+    tileScheduler scheduler(tiles, threadCount);
+
+    parallelFor(0, threadCount, threadCount, [&](uint64_t workerBegin, uint64_t workerEnd, int worker){
+        imageTile tile;
+        while(scheduler.next(worker, tile)){
+            renderTile(tile, worker);
+        }
+    });
+}
+
+#endif //TILE_SCHEDULER_HPP
@@ -0,0 +1,109 @@
+#ifndef TWO_LEVEL_BVH_HPP
+#define TWO_LEVEL_BVH_HPP
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "bvhNode.hpp"
+#include "instance.hpp"
+
+//bottom level bvhs are built once per object group and shared by every instance of that group, the top level bvh only
+//indexes the instances' world boxes. Moving instances costs a top level rebuild, the bottom levels are never touched again
+class twoLevelBvh : public hittable{
+private:
+    std::unordered_map<const hittable*, std::shared_ptr<hittable>> bottomLevels;   //keyed by the group they were built from
+    std::vector<std::shared_ptr<instance>> instances;
+    std::shared_ptr<hittable> staticGeometry;   //everything that is not instanced, in world space
+    std::shared_ptr<bvhNode> topLevel;
+    bvhSettings settings;
+    float tStart;
+    float tEnd;
+
+public:
+    twoLevelBvh(const bvhSettings& settings = bvhSettings(), float tStart = 0.0, float tEnd = 1.0):
+        settings{settings},
+        tStart{tStart},
+        tEnd{tEnd}
+        {}
+
+    //instances in world (see bakeTransforms) become top level instances of their inner object, instances sharing an inner
+    //object share its bottom level. The remaining objects get one bottom level of their own
+    twoLevelBvh(const hittableList& world, float tStart = 0.0, float tEnd = 1.0, const bvhSettings& settings = bvhSettings()):
+        twoLevelBvh(settings, tStart, tEnd)
+        {
+            hittableList staticObjects;
+            for(const std::shared_ptr<hittable>& object : world.objectList()){
+                if(const instance* placed = dynamic_cast<const instance*>(object.get()))
+                    addInstance(placed->inner(), placed->transform());
+                else
+                    staticObjects.add(object);
+            }
+
+            if(!staticObjects.objectList().empty())
+                staticGeometry = std::make_shared<bvhNode>(staticObjects, tStart, tEnd, settings);
+
+            rebuildTopLevel();
+        }
+
+    //bvh over group, built on first use
+    std::shared_ptr<hittable> bottomLevel(const std::shared_ptr<hittable>& group){
+        auto entry = bottomLevels.find(group.get());
+        if(entry != bottomLevels.end())
+            return entry->second;
+
+        std::shared_ptr<hittable> built;
+        if(const hittableList* list = dynamic_cast<const hittableList*>(group.get()))
+            built = std::make_shared<bvhNode>(*list, tStart, tEnd, settings);
+        else
+            built = std::make_shared<bvhNode>(hittableList(group), tStart, tEnd, settings);
+
+        bottomLevels[group.get()] = built;
+        return built;
+    }
+
+    //places a copy of group, returns the index for setTransform. Takes effect with the next rebuildTopLevel
+    size_t addInstance(const std::shared_ptr<hittable>& group, const glm::mat4& objectToWorld = glm::mat4(1.0f)){
+        instances.push_back(std::make_shared<instance>(bottomLevel(group), objectToWorld));
+        return instances.size() - 1;
+    }
+
+    //takes effect with the next rebuildTopLevel, which must not run while rays are traced
+    void setTransform(size_t instanceIndex, const glm::mat4& objectToWorld){
+        instances[instanceIndex]->setTransform(objectToWorld);
+    }
+
+    void rebuildTopLevel(){
+        hittableList topLevelObjects;
+        if(staticGeometry)
+            topLevelObjects.add(staticGeometry);
+        for(const std::shared_ptr<instance>& placed : instances){
+            topLevelObjects.add(placed);
+        }
+
+        topLevel = topLevelObjects.objectList().empty() ? nullptr : std::make_shared<bvhNode>(topLevelObjects, tStart, tEnd, settings);
+    }
+
+    size_t instanceCount() const { return instances.size(); }
+    size_t bottomLevelCount() const { return bottomLevels.size() + (staticGeometry ? 1 : 0); }
+
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
+        return topLevel && topLevel->intersect(r, distMin, distMax, query);
+    }
+
+    virtual bool occluded(const ray& r, float distMin, float distMax) const override {
+        return topLevel && topLevel->occluded(r, distMin, distMax);
+    }
+
+    virtual int hitPacket(const rayPacket& packet, int activeMask, float distMin, float distMax[rayPacket::width], hitRecord records[rayPacket::width]) const override {
+        return topLevel ? topLevel->hitPacket(packet, activeMask, distMin, distMax, records) : 0;
+    }
+
+    virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
+        return topLevel && topLevel->boundingBox(tStart, tEnd, refbox);
+    }
+};
+
+#endif //TWO_LEVEL_BVH_HPP
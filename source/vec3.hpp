@@ -124,39 +124,29 @@ inline float lengthSquared(const glm::vec3& vec){
     return glm::dot(vec, vec);
 }
 
+//Rec. 709 luminance of a linear color
+inline float luminance(const color& c){
+    return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b;
+}
+
 inline bool nearZero(const glm::vec3& vec){
     return vec.x < 1e-8 && vec.y < 1e-8 && vec.z < 1e-8;
 }
 
-glm::vec3 randomVec3(float inclusiveMin = 0.0f, float exclusiveMax = 1.0f){
-    return glm::vec3(randomFloat(sharedRng, inclusiveMin, exclusiveMax), randomFloat(sharedRng, inclusiveMin, exclusiveMax), randomFloat(sharedRng, inclusiveMin, exclusiveMax));
+glm::vec3 randomVec3(pcg32& rng, float inclusiveMin = 0.0f, float exclusiveMax = 1.0f){
+    return glm::vec3(randomFloat(rng, inclusiveMin, exclusiveMax), randomFloat(rng, inclusiveMin, exclusiveMax), randomFloat(rng, inclusiveMin, exclusiveMax));
 }
 
-glm::vec3 randomInUnitSphere(){
+glm::vec3 randomInUnitSphere(pcg32& rng){
     while(true){
-        glm::vec3 insideSphereVector = randomVec3(-1.0, 1.0);
-        if(lengthSquared(insideSphereVector) < 1);
+        glm::vec3 insideSphereVector = randomVec3(rng, -1.0, 1.0);
+        if(lengthSquared(insideSphereVector) < 1)
             return insideSphereVector;
     }
 }
 
-glm::vec3 randomUnitVector(){
-    return glm::normalize(randomInUnitSphere());
-}
-
-glm::vec3 randomInHemisphere(const glm::vec3& faceNormal){
-    glm::vec3 inUnitSphere = randomInUnitSphere();
-    float dotproduct = glm::dot(inUnitSphere, faceNormal);
-
-    return (dotproduct / std::fabs(dotproduct)) * inUnitSphere;
-}
-
-glm::vec3 randomInUnitDisk(){
-    while(true){
-        point3 point = glm::vec3(randomFloat(sharedRng, -1.0, 1.0), randomFloat(sharedRng, -1.0, 1.0), 0);
-        if(lengthSquared(point) < 1)
-            return point;
-    }
+glm::vec3 randomUnitVector(pcg32& rng){
+    return glm::normalize(randomInUnitSphere(rng));
 }
 
 glm::vec3 reflect(const glm::vec3& incomingVector, const glm::vec3& normalVector){
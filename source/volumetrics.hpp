@@ -1,6 +1,7 @@
 #ifndef VOLUMETRICS_HPP
 #define VOLUMETRICS_HPP
 
+#include <cstring>
 #include "rtweekend.hpp"
 #include "hittable.hpp"
 #include "material.hpp"
@@ -12,6 +13,20 @@ private:
     std::shared_ptr<material> phaseFunction;
     float negativeInverseDensity;
 
+    //intersect has no sampler argument, so the free flight distance comes from a generator keyed by the ray itself. Rays are made
+    //from the path's samples, so the distances follow the render seed and do not depend on the thread or the order of the work.
+    //The same ray always gets the same distance, so occluded agrees with intersect
+    pcg32 rayRng(const ray& r) const {
+        const float key[7] = { r.origin().x, r.origin().y, r.origin().z, r.direction().x, r.direction().y, r.direction().z, r.hitTime() };
+        uint64_t hashed = objectId;
+        for(float component : key){
+            uint32_t bits;
+            std::memcpy(&bits, &component, sizeof(bits));
+            hashed = mixSeed(hashed ^ bits);
+        }
+        return pcg32(hashed, objectId);
+    }
+
 public:
     constantMedium(std::shared_ptr<hittable> boundary, float density, std::shared_ptr<texture> texture):
         boundary{boundary},
@@ -21,61 +36,67 @@ public:
 
     constantMedium(std::shared_ptr<hittable> boundary, float density, color volumeColor):
         boundary{boundary},
-        negativeInverseDensity{1.0f/density},
+        negativeInverseDensity{-1.0f/density},
         phaseFunction{std::make_shared<isotropic>(volumeColor)}
         {}
     
-    virtual bool hit(const ray& ray, float distMin, float distMax, hitRecord& record) const override {
+    virtual bool intersect(const ray& r, float distMin, float distMax, hitQuery& query) const override {
+        pcg32 rng = rayRng(r);
+        const float freeFlightSample = randomFloat(rng);    //drawn first, debug printing must not change it
+
         #ifdef DEBUG
         const bool debugPrinting = false;
-        const bool debugging = debugPrinting && randomFloat() < 0.000001;
+        const bool debugging = debugPrinting && randomFloat(rng) < 0.000001;
         #endif
 
-        hitRecord record1, record2;
+        hitQuery query1, query2;
         float inf = std::numeric_limits<float>::infinity();
 
-        bool record1hit = boundary->hit(r, -inf, inf, record1);
-        bool record2hit = boundary->hit(r, record.distance + 0.0001, inf, record2);
+        bool query1hit = boundary->intersect(r, -inf, inf, query1);
+        bool query2hit = query1hit && boundary->intersect(r, query1.distance + 0.0001, inf, query2);
 
-        if(!record1hit || !record2hit)
+        if(!query1hit || !query2hit)
             return false;
 
         #ifdef DEBUG
         if(debugging)
-            std::cerr << "\ndistMin: " << record1.distance << ", distMax: " << record2.distance << "\n";
+            std::cerr << "\ndistMin: " << query1.distance << ", distMax: " << query2.distance << "\n";
         #endif
         
-        record1.distance = std::max(record1.distance, distMin);
-        record2.distance = std::min(record2.distance, distMax);
+        query1.distance = std::max(query1.distance, distMin);
+        query2.distance = std::min(query2.distance, distMax);
 
-        if(record1.distance >= record2.distance)
+        if(query1.distance >= query2.distance)
             return false;
 
-        record1.distance = std::min(record1.distance, 0);
+        query1.distance = std::max(query1.distance, 0.0f);
 
-        const float raySpeed = ray.direction().length();
-        const float distanceInBoundary = (record2.distance - record1.distance) * raySpeed;
-        const float hitDistance = negativeInverseDensity * log(randomFloat());
+        const float raySpeed = glm::length(r.direction());
+        const float distanceInBoundary = (query2.distance - query1.distance) * raySpeed;
+        const float hitDistance = negativeInverseDensity * log(1.0f - freeFlightSample);
 
         if(hitDistance > distanceInBoundary)
             return false;
 
-        record.distance = record1.distance / raySpeed;
-        record.hitLocation = ray.at(record.distance);
-        
+        query.claim(this, query1.distance + hitDistance / raySpeed);
+
         #ifdef DEBUG
         if(debugging){
-            std::cerr << "hit_distance = " <<  hit_distance << '\n'
-                      << "record.distance = " <<  record.distance << '\n'
-                      << "record.hitLocation = " <<  record.hitLocation << '\n';
+            std::cerr << "hit_distance = " <<  hitDistance << '\n'
+                      << "query.distance = " <<  query.distance << '\n';
         }
         #endif
 
-        record.normal = vec3(1,0,0); //some arbitrary normal
+        return true;
+    }
+
+    virtual void finalize(const ray& r, const hitQuery& query, hitRecord& record) const override {
+        record.distance = query.distance;
+        record.hitLocation = r.at(query.distance);
+        record.normal = glm::vec3(1,0,0); //some arbitrary normal
         record.frontFace = true; // another arbitrary value
         record.materialPointer = phaseFunction;
-
-        return true;
+        record.objectId = objectId;
     }
 
     virtual bool boundingBox(float tStart, float tEnd, axisAlignedBoundingBox& refbox) const override {
@@ -0,0 +1,335 @@
+#ifndef WAVEFRONT_HPP
+#define WAVEFRONT_HPP
+
+#include <vector>
+#include <algorithm>
+#include "rtweekend.hpp"
+#include "hittable.hpp"
+#include "hittableList.hpp"
+#include "material.hpp"
+#include "camera.hpp"
+#include "sampler.hpp"
+#include "tileScheduler.hpp"
+
+enum class renderMode{
+    recursive,
+    wavefront
+};
+
+//path states of one wave in SoA layout, paths that terminate are compacted away after every bounce
+struct wavefrontPaths{
+    std::vector<float> originX, originY, originZ;
+    std::vector<float> directionX, directionY, directionZ;
+    std::vector<float> time;
+    std::vector<float> throughputR, throughputG, throughputB;
+    std::vector<float> scatterPdf;  //pdf of the bounce that produced the ray, 0 for camera rays and specular bounces
+    std::vector<float> scatterNormalX, scatterNormalY, scatterNormalZ;  //normal where that bounce happened, light selection depends on it
+    std::vector<uint32_t> pixel;    //index into the sample sums of the wave, pixel of the wave * pixelSampleCount + sample of the pass
+    std::vector<uint32_t> imageX, imageY, sample;    //camera sample the path belongs to, the sampler is restarted from it every bounce
+
+    size_t size() const { return pixel.size(); }
+
+    void resize(size_t pathCount){
+        for(std::vector<float>* channel : { &originX, &originY, &originZ, &directionX, &directionY, &directionZ, &time, &throughputR, &throughputG, &throughputB,
+                                             &scatterPdf, &scatterNormalX, &scatterNormalY, &scatterNormalZ }){
+            channel->resize(pathCount);
+        }
+        for(std::vector<uint32_t>* channel : { &pixel, &imageX, &imageY, &sample }){
+            channel->resize(pathCount);
+        }
+    }
+
+    ray getRay(size_t i) const {
+        return ray(point3(originX[i], originY[i], originZ[i]), glm::vec3(directionX[i], directionY[i], directionZ[i]), time[i]);
+    }
+
+    void setRay(size_t i, const ray& r){
+        originX[i] = r.origin().x; originY[i] = r.origin().y; originZ[i] = r.origin().z;
+        directionX[i] = r.direction().x; directionY[i] = r.direction().y; directionZ[i] = r.direction().z;
+        time[i] = r.hitTime();
+    }
+
+    glm::vec3 scatterNormal(size_t i) const {
+        return glm::vec3(scatterNormalX[i], scatterNormalY[i], scatterNormalZ[i]);
+    }
+
+    void setScatter(size_t i, float pdf, const glm::vec3& normal){
+        scatterPdf[i] = pdf;
+        scatterNormalX[i] = normal.x; scatterNormalY[i] = normal.y; scatterNormalZ[i] = normal.z;
+    }
+
+    color throughput(size_t i) const {
+        return color(throughputR[i], throughputG[i], throughputB[i]);
+    }
+
+    void setThroughput(size_t i, const color& value){
+        throughputR[i] = value.r; throughputG[i] = value.g; throughputB[i] = value.b;
+    }
+
+    void copy(const wavefrontPaths& source, size_t from, size_t to){
+        originX[to] = source.originX[from]; originY[to] = source.originY[from]; originZ[to] = source.originZ[from];
+        directionX[to] = source.directionX[from]; directionY[to] = source.directionY[from]; directionZ[to] = source.directionZ[from];
+        time[to] = source.time[from];
+        throughputR[to] = source.throughputR[from]; throughputG[to] = source.throughputG[from]; throughputB[to] = source.throughputB[from];
+        scatterPdf[to] = source.scatterPdf[from];
+        scatterNormalX[to] = source.scatterNormalX[from]; scatterNormalY[to] = source.scatterNormalY[from]; scatterNormalZ[to] = source.scatterNormalZ[from];
+        pixel[to] = source.pixel[from];
+        imageX[to] = source.imageX[from]; imageY[to] = source.imageY[from]; sample[to] = source.sample[from];
+    }
+};
+
+struct wavefrontHits{
+    std::vector<hitRecord> records;
+    std::vector<char> hit;
+    std::vector<char> alive;
+    std::vector<std::pair<const material*, uint32_t>> shadeOrder;
+    std::vector<std::pair<uint64_t, uint32_t>> rayOrder;
+    wavefrontPaths sortedPaths;
+
+    void resize(size_t pathCount){
+        records.resize(pathCount);
+        hit.resize(pathCount);
+        alive.resize(pathCount);
+        shadeOrder.reserve(pathCount);
+    }
+};
+
+//stage 1: one camera ray per (pixel, sample) of the wave, the rows [rowStart, rowStart + rowCount) of the tile and the samples [sampleStart, sampleStart + pixelSampleCount),
+//neighbouring pixels of the same sample end up next to each other
+void wavefrontGenerate(wavefrontPaths& paths, const imageTile& tile, int rowStart, int rowCount, int image_width, int image_height, int sampleStart, int pixelSampleCount,
+                       const camera& worldCamera, sampler& samples){
+    const int tileWidth = tile.width();
+    paths.resize(static_cast<size_t>(rowCount) * tileWidth * pixelSampleCount);
+    size_t pathIndex = 0;
+
+    for(int s = 0; s < pixelSampleCount; s++){
+        for(int row = 0; row < rowCount; row++){
+            int y = image_height - 1 - (rowStart + row);
+            for(int x = tile.x0; x < tile.x1; x++){
+                samples.startPixelSample(x, y, sampleStart + s);
+                glm::vec2 pixelOffset = samples.get2D();
+                double u = (x + pixelOffset.x) / (image_width - 1);
+                double v = (y + pixelOffset.y) / (image_height - 1);
+
+                paths.setRay(pathIndex, worldCamera.getRay(u, v, samples));
+                paths.setThroughput(pathIndex, color(1,1,1));
+                paths.setScatter(pathIndex, 0.0f, glm::vec3(0,0,0));
+                paths.pixel[pathIndex] = static_cast<uint32_t>((row * tileWidth + x - tile.x0) * pixelSampleCount + s);
+                paths.imageX[pathIndex] = x;
+                paths.imageY[pathIndex] = y;
+                paths.sample[pathIndex] = sampleStart + s;
+                pathIndex++;
+            }
+        }
+    }
+}
+
+//spreads the low 10 bits of value so two zero bits sit between each of them
+inline uint32_t mortonSpread(uint32_t value){
+    value &= 0x3FF;
+    value = (value | (value << 16)) & 0x030000FF;
+    value = (value | (value << 8))  & 0x0300F00F;
+    value = (value | (value << 4))  & 0x030C30C3;
+    value = (value | (value << 2))  & 0x09249249;
+    return value;
+}
+
+//secondary rays are sorted by direction octant, then by the morton code of their origin inside the scene bounds,
+//so neighbouring paths walk the same part of the bvh and mostly form coherent packets
+void wavefrontReorder(wavefrontPaths& paths, wavefrontHits& hits, const axisAlignedBoundingBox& sceneBox){
+    const size_t pathCount = paths.size();
+    const glm::vec3 sceneMin = sceneBox.cornerClosest();
+    const glm::vec3 cellScale = 1023.0f / glm::max(sceneBox.extent(), glm::vec3(1e-6f));
+
+    hits.rayOrder.resize(pathCount);
+    for(size_t i = 0; i < pathCount; i++){
+        uint64_t octant = (paths.directionX[i] < 0.0f ? 1 : 0) | (paths.directionY[i] < 0.0f ? 2 : 0) | (paths.directionZ[i] < 0.0f ? 4 : 0);
+        glm::vec3 cell = glm::clamp((glm::vec3(paths.originX[i], paths.originY[i], paths.originZ[i]) - sceneMin) * cellScale, glm::vec3(0.0f), glm::vec3(1023.0f));
+        uint32_t morton = mortonSpread(static_cast<uint32_t>(cell.x)) | (mortonSpread(static_cast<uint32_t>(cell.y)) << 1) | (mortonSpread(static_cast<uint32_t>(cell.z)) << 2);
+
+        hits.rayOrder[i] = { (octant << 30) | morton, static_cast<uint32_t>(i) };
+    }
+
+    std::sort(hits.rayOrder.begin(), hits.rayOrder.end());
+
+    hits.sortedPaths.resize(pathCount);
+    for(size_t i = 0; i < pathCount; i++){
+        hits.sortedPaths.copy(paths, hits.rayOrder[i].second, i);
+    }
+    std::swap(paths, hits.sortedPaths);
+}
+
+//stage 2: closest hits for every path, camera rays and reordered secondary rays go through the packet path
+void wavefrontIntersect(const wavefrontPaths& paths, wavefrontHits& hits, const hittable& world, bool usePackets){
+    const size_t pathCount = paths.size();
+    size_t i = 0;
+
+    if(usePackets){
+        for(; i + rayPacket::width <= pathCount; i += rayPacket::width){
+            rayPacket packet;
+            for(int lane = 0; lane < rayPacket::width; lane++){
+                packet.setRay(lane, paths.getRay(i + lane));
+            }
+            packet.finalize();
+
+            float distMax[rayPacket::width];
+            std::fill(distMax, distMax + rayPacket::width, infinity);
+            int hitMask = world.hitPacket(packet, packet.laneMask, 0.001, distMax, &hits.records[i]);
+
+            for(int lane = 0; lane < rayPacket::width; lane++){
+                hits.hit[i + lane] = (hitMask & (1 << lane)) != 0;
+            }
+        }
+    }
+
+    for(; i < pathCount; i++){
+        hits.hit[i] = world.hit(paths.getRay(i), 0.001, infinity, hits.records[i]);
+    }
+}
+
+//stage 3: paths are shaded grouped by material so each material's scatter code runs back to back,
+//shadow rays of next event estimation are traced right away against world
+void wavefrontShade(wavefrontPaths& paths, wavefrontHits& hits, std::vector<color>& sampleSums, const renderSettings& settings, const hittable& world, int depth, sampler& samples){
+    const size_t pathCount = paths.size();
+    const bool sampleLights = settings.lights && !settings.lights->empty();
+    hits.shadeOrder.clear();
+
+    for(size_t i = 0; i < pathCount; i++){
+        if(hits.hit[i]){
+            hits.shadeOrder.push_back({ hits.records[i].materialPointer.get(), static_cast<uint32_t>(i) });
+        }
+        else{
+            sampleSums[paths.pixel[i]] += paths.throughput(i) * settings.backgroundColor;
+            hits.alive[i] = false;
+        }
+    }
+
+    std::sort(hits.shadeOrder.begin(), hits.shadeOrder.end());
+
+    for(const std::pair<const material*, uint32_t>& entry : hits.shadeOrder){
+        const material* surfaceMaterial = entry.first;
+        const uint32_t i = entry.second;
+        const hitRecord& record = hits.records[i];
+        const color throughput = paths.throughput(i);
+        const ray rayIncoming = paths.getRay(i);
+
+        color emitted = surfaceMaterial->emitted(record.u, record.v, record.hitLocation);
+        if(emitted != color(0,0,0))
+            sampleSums[paths.pixel[i]] += throughput * emitted * emissionWeight(settings.lights, rayIncoming, paths.scatterNormal(i), record, paths.scatterPdf[i]);
+
+        //the last bounce's scattered rays would not be traced anymore
+        if(depth + 1 == settings.maxDepth){
+            hits.alive[i] = false;
+            continue;
+        }
+
+        ray rayScattered;
+        color attenuation;
+        samples.startPixelSample(paths.imageX[i], paths.imageY[i], paths.sample[i]);
+        samples.startBounce(depth + 1);
+        const bool diffuse = surfaceMaterial->samplesLights();
+        if(sampleLights && diffuse)
+            sampleSums[paths.pixel[i]] += throughput * sampleDirectLight(rayIncoming, record, *settings.lights, world, samples);
+
+        if(!surfaceMaterial->scatter(rayIncoming, record, attenuation, rayScattered, samples)){
+            hits.alive[i] = false;
+            continue;
+        }
+
+        color scatteredThroughput = throughput * attenuation;
+        if(depth + 1 >= settings.russianRouletteDepth && !russianRoulette(scatteredThroughput, samples)){
+            hits.alive[i] = false;
+            continue;
+        }
+
+        paths.setRay(i, rayScattered);
+        paths.setThroughput(i, scatteredThroughput);
+        paths.setScatter(i, diffuse ? surfaceMaterial->scatterPdf(rayIncoming, record, rayScattered.direction()) : 0.0f, record.normal);
+        hits.alive[i] = true;
+    }
+}
+
+//stage 4: stable in place compaction of the surviving paths
+void wavefrontCompact(wavefrontPaths& paths, const wavefrontHits& hits){
+    size_t aliveCount = 0;
+
+    for(size_t i = 0; i < paths.size(); i++){
+        if(!hits.alive[i])
+            continue;
+
+        if(i != aliveCount)
+            paths.copy(paths, i, aliveCount);
+        aliveCount++;
+    }
+
+    paths.resize(aliveCount);
+}
+
+//every bounce of a whole wave of paths is processed stage by stage, reorderRays sorts the secondary rays before intersecting them,
+//large tiles are split into waves of whole rows
+void renderWaves(const imageTile& tile, const renderSettings& settings, framebuffer& output, aovBuffers* aovs, const camera& worldCamera, const hittableList& world, bool reorderRays){
+    axisAlignedBoundingBox sceneBox;
+    if(!world.boundingBox(0.0, 1.0, sceneBox))
+        reorderRays = false;
+
+    const int pixelSampleCount = settings.pixelSampleCount;
+    const size_t targetWaveSize = 1 << 16;
+    const int rowsPerWave = std::max(1, static_cast<int>(targetWaveSize / (static_cast<size_t>(tile.width()) * pixelSampleCount)));
+
+    sampler samples(settings.sampling, settings.seed, settings.samplerSampleCount());
+    wavefrontPaths paths;
+    wavefrontHits hits;
+    std::vector<color> sampleSums;
+    std::vector<aovSample> pixelAovs;
+
+    for(int rowStart = tile.row0; rowStart < tile.row1; rowStart += rowsPerWave){
+        const int rowCount = std::min(rowsPerWave, tile.row1 - rowStart);
+
+        wavefrontGenerate(paths, tile, rowStart, rowCount, settings.image_width, settings.image_height, settings.sampleStart, pixelSampleCount, worldCamera, samples);
+        hits.resize(paths.size());
+        sampleSums.assign(paths.size(), color(0,0,0));
+        if(aovs)
+            pixelAovs.assign(static_cast<size_t>(rowCount) * tile.width(), aovSample());
+
+        for(int depth = 0; depth < settings.maxDepth && paths.size() > 0; depth++){
+            if(reorderRays && depth > 0)
+                wavefrontReorder(paths, hits, sceneBox);
+
+            wavefrontIntersect(paths, hits, world, depth == 0 || reorderRays);
+
+            //the camera rays are still in generation order here, so every pixel sees its sample 0 first
+            if(aovs && depth == 0){
+                for(size_t i = 0; i < paths.size(); i++){
+                    pixelAovs[paths.pixel[i] / pixelSampleCount].add(paths.getRay(i), hits.hit[i], hits.records[i], settings.backgroundColor);
+                }
+            }
+
+            wavefrontShade(paths, hits, sampleSums, settings, world, depth, samples);
+            wavefrontCompact(paths, hits);
+        }
+
+        for(int row = 0; row < rowCount; row++){
+            for(int x = tile.x0; x < tile.x1; x++){
+                const size_t pixel = static_cast<size_t>(row) * tile.width() + x - tile.x0;
+                color pixelColorSum = color(0,0,0);
+                float luminanceSquareSum = 0.0f;
+                for(int s = 0; s < pixelSampleCount; s++){
+                    const color& sampleColor = sampleSums[pixel * pixelSampleCount + s];
+                    pixelColorSum += sampleColor;
+                    luminanceSquareSum += luminance(sampleColor) * luminance(sampleColor);
+                }
+
+                output.addSamples(x, rowStart + row, pixelColorSum, pixelSampleCount, luminanceSquareSum);
+                if(aovs)
+                    aovs->addSamples(x, rowStart + row, pixelAovs[pixel]);
+            }
+        }
+    }
+}
+
+//same arguments and output as renderImage
+void renderImageWavefront(const imageTile& tile, const renderSettings& settings, framebuffer& output, aovBuffers* aovs, const camera& worldCamera, const hittableList& world){
+    renderWaves(tile, settings, output, aovs, worldCamera, world, true);
+}
+
+#endif //WAVEFRONT_HPP
@@ -1,61 +1,38 @@
 #ifndef WORK_COUNTER_HPP
 #define WORK_COUNTER_HPP
 
-//TODO: implement seperate workDones
+//counts finished tiles, the albedo and normal aovs are rendered in the same pass so there is only one kind of work
 class workCounter{
 private:
-    std::atomic<int> workDoneMain;
-    std::atomic<int> workDoneAlbedo;
-    std::atomic<int> workDoneNormal;
+    std::atomic<int> workDone;
     int totalWork;
-    int threadCount;
-    int image_height;
 
 public:
-    workCounter(int image_height, int threadCount):
-        image_height{image_height},
-        threadCount{threadCount},
-        totalWork{image_height * threadCount}
+    workCounter(int totalWork):
+        totalWork{totalWork}
         {
-            std::atomic_init(&workDoneMain, 0);
-            std::atomic_init(&workDoneAlbedo, 0);
-            std::atomic_init(&workDoneNormal, 0);
+            std::atomic_init(&workDone, 0);
         }
 
-    void incrementWorkMain(int increments = 1){
-        std::atomic_fetch_add(&workDoneMain, increments);
-    }
-
-    void incrementWorkAlbedo(int increments = 1){
-        std::atomic_fetch_add(&workDoneAlbedo, increments);
-    }
-
-    void incrementWorkNormal(int increments = 1){
-        std::atomic_fetch_add(&workDoneNormal, increments);
+    void incrementWork(int increments = 1){
+        std::atomic_fetch_add(&workDone, increments);
     }
 
     void outputWorkDone(){
         std::ostringstream outputLine;
-        int workDoneMainNonAtomic = std::atomic_load(&workDoneMain);
-        int workDoneAlbedoNonAtomic = std::atomic_load(&workDoneAlbedo);
-        int workDoneNormalNonAtomic = std::atomic_load(&workDoneNormal);
-        int totalWorkDoneNonAtomic = workDoneAlbedoNonAtomic + workDoneNormalNonAtomic + workDoneMainNonAtomic;
+        int workDoneNonAtomic = std::atomic_load(&workDone);
 
-        outputLine << "\rTotal: " << static_cast<int>((double(totalWorkDoneNonAtomic) / double(totalWork * 3)) * 100.0) << "%" 
-        << " | "
-        << "Main:" << workDoneMainNonAtomic << "/" << totalWork
-        << " | "
-        << "Albedo: " << workDoneAlbedoNonAtomic << "/" << totalWork
+        outputLine << "\rTotal: " << static_cast<int>((double(workDoneNonAtomic) / double(totalWork)) * 100.0) << "%"
         << " | "
-        << "Normal: " << workDoneNormalNonAtomic << "/" << totalWork;
+        << "Tiles: " << workDoneNonAtomic << "/" << totalWork;
 
         std::cerr << outputLine.str() << std::flush;
     }
 
     bool isWorkDone(){
-        return std::atomic_load(&workDoneMain) == totalWork && std::atomic_load(&workDoneAlbedo) == totalWork && std::atomic_load(&workDoneNormal) == totalWork;
+        return std::atomic_load(&workDone) == totalWork;
     }
 
 };
 
-#endif //WORK_COUNTER_HPP
\ No newline at end of file
+#endif //WORK_COUNTER_HPP